@@ -0,0 +1,198 @@
+/* ----------
+ * fuzz_pglz.c -
+ *
+ *		libFuzzer and AFL target for the registered codecs.
+ *
+ *		The first input byte selects the check.  If its lowest bit is
+ *		clear, the rest of the input is raw data: it is compressed by every
+ *		compressor, and every result is decompressed by every decompressor,
+ *		all cross-checked against the vanilla codecs.  Otherwise the next
+ *		two bytes give the output size and the rest is fed to every
+ *		decompressor as a possibly malformed stream, which must be decoded
+ *		exactly as pglz_decompress_vanilla() does; bit 1 of the first byte
+ *		is check_complete.  Any difference aborts.
+ *
+ *		Built by "make fuzz_pglz".  The default FUZZ_FLAGS link with
+ *		libFuzzer.  With -DPGLZ_FUZZ_MAIN there is a main() instead that
+ *		runs the files named on the command line, or standard input, which
+ *		suits AFL and replaying crashes.
+ *
+ * Copyright (c) 1999-2019, PostgreSQL Global Development Group
+ *
+ * contrib/test_pglz/fuzz_pglz.c
+ * ----------
+ */
+#include "postgres.h"
+
+#include <stdio.h>
+
+#include "common/pg_lzcompress.h"
+#include "pg_lzcompress_hacked.h"
+
+
+/* Largest output size tried for malformed streams */
+#define PGLZ_FUZZ_MAX_RAWSIZE	8192
+
+int			LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+
+/* ----------
+ * pglz_fuzz_check -
+ *
+ *		Aborts if a verification routine reported a failure.
+ * ----------
+ */
+static void
+pglz_fuzz_check(const char *failure, const PGLZ_Codec *codec)
+{
+	if (failure == NULL)
+		return;
+	fprintf(stderr, "%s: %s\n", codec->name, failure);
+	abort();
+}
+
+
+/* ----------
+ * pglz_fuzz_roundtrip -
+ *
+ *		Checks all codec pairs on raw data.
+ * ----------
+ */
+static void
+pglz_fuzz_roundtrip(const char *source, int32 slen)
+{
+	char	   *compressed = malloc(PGLZ_VERIFY_COMPRESS_SPACE(slen));
+	int			c,
+				d;
+
+	if (compressed == NULL)
+		return;
+
+	for (c = 0; c < pglz_compressors_count; c++)
+	{
+		const PGLZ_Codec *compressor = &pglz_compressors[c];
+		int32		clen;
+
+		if (!pglz_codec_usable(compressor))
+			continue;
+		pglz_fuzz_check(pglz_verify_compress(compressor, source, slen,
+											 compressed, &clen),
+						compressor);
+		if (clen < 0)
+			continue;
+
+		for (d = 0; d < pglz_decompressors_count; d++)
+		{
+			const PGLZ_Codec *decompressor = &pglz_decompressors[d];
+
+			if (!pglz_codec_usable(decompressor))
+				continue;
+			pglz_fuzz_check(pglz_verify_decompress(decompressor, compressed,
+												   clen, source, slen),
+							decompressor);
+		}
+	}
+
+	free(compressed);
+}
+
+
+/* ----------
+ * LLVMFuzzerTestOneInput -
+ *
+ *		The fuzz target.
+ * ----------
+ */
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	int			d;
+
+	if (size < 1 || size > PG_INT32_MAX / 2)
+		return 0;
+
+	if ((data[0] & 1) == 0)
+	{
+		pglz_fuzz_roundtrip((const char *) data + 1, size - 1);
+		return 0;
+	}
+
+	if (size < 3)
+		return 0;
+	for (d = 0; d < pglz_decompressors_count; d++)
+	{
+		const PGLZ_Codec *decompressor = &pglz_decompressors[d];
+		int32		rawsize = (data[1] | data[2] << 8) % (PGLZ_FUZZ_MAX_RAWSIZE + 1);
+
+		if (!pglz_codec_usable(decompressor))
+			continue;
+		pglz_fuzz_check(pglz_verify_stream(decompressor,
+										   (const char *) data + 3, size - 3,
+										   rawsize, (data[0] & 2) != 0),
+						decompressor);
+	}
+
+	return 0;
+}
+
+
+#ifdef PGLZ_FUZZ_MAIN
+/* ----------
+ * pglz_fuzz_file -
+ *
+ *		Runs the target on the contents of file.
+ * ----------
+ */
+static void
+pglz_fuzz_file(FILE *file)
+{
+	char	   *buf = NULL;
+	size_t		size = 0;
+	size_t		allocated = 0;
+	size_t		n;
+
+	do
+	{
+		if (size == allocated)
+		{
+			allocated = allocated ? allocated * 2 : 65536;
+			buf = realloc(buf, allocated);
+			if (buf == NULL)
+			{
+				fprintf(stderr, "out of memory\n");
+				exit(1);
+			}
+		}
+		n = fread(buf + size, 1, allocated - size, file);
+		size += n;
+	} while (n > 0);
+
+	LLVMFuzzerTestOneInput((const uint8_t *) buf, size);
+	free(buf);
+}
+
+
+int
+main(int argc, char **argv)
+{
+	int			i;
+
+	if (argc < 2)
+		pglz_fuzz_file(stdin);
+
+	for (i = 1; i < argc; i++)
+	{
+		FILE	   *file = fopen(argv[i], "rb");
+
+		if (file == NULL)
+		{
+			fprintf(stderr, "could not open \"%s\"\n", argv[i]);
+			return 1;
+		}
+		pglz_fuzz_file(file);
+		fclose(file);
+	}
+
+	return 0;
+}
+#endif							/* PGLZ_FUZZ_MAIN */
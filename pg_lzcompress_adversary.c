@@ -0,0 +1,211 @@
+/* ----------
+ * pg_lzcompress_adversary.c -
+ *
+ *		Generators of synthetic worst-case payloads.
+ *
+ *		The payload files show typical behaviour; these inputs are built
+ *		to hit the slow paths instead:
+ *
+ *			adversary_rnd			random bytes, nothing to compress
+ *			adversary_runs			runs of one byte of up to 4kB, which
+ *									become chains of longest matches
+ *			adversary_offset1		short runs between literals, many
+ *									short matches with offset 1
+ *			adversary_offset2		short repeats of two byte patterns,
+ *									many short matches with offset 2
+ *			adversary_maxmatch		a random block of 1kB repeated, so
+ *									that even 2kB slices are nothing but
+ *									longest matches
+ *			adversary_collisions	groups of 4 bytes that all fall into
+ *									one pglz_hist_idx() slot, most of
+ *									them repeats of an earlier group, so
+ *									that the input compresses enough to
+ *									be kept on and every lookup walks
+ *									the whole history chain for matches
+ *									that are never good enough to stop
+ *
+ *		The output only depends on the size, so that runs can be compared.
+ *
+ * Copyright (c) 1999-2019, PostgreSQL Global Development Group
+ *
+ * contrib/test_pglz/pg_lzcompress_adversary.c
+ * ----------
+ */
+#include "postgres.h"
+
+#include "common/pg_lzcompress.h"
+#include "pg_lzcompress_hacked.h"
+
+
+/*
+ * The history slot all groups of adversary_collisions aim for, and the
+ * mask of the largest history table.  Inputs colliding in it collide for
+ * the smaller tables of short inputs as well.
+ */
+#define PGLZ_ADVERSARY_SLOT		0x1234
+#define PGLZ_ADVERSARY_MASK		(PGLZ_MAX_HISTORY_LISTS - 1)
+
+/*
+ * adversary_collisions repeats 7 of 8 groups from at most this many
+ * groups back, so that even a 2kB slice finds most of its repeats in
+ * itself and compresses by more than the 25% of the default strategy.
+ */
+#define PGLZ_ADVERSARY_REACH	256
+
+
+/* ----------
+ * pglz_adversary_random -
+ *
+ *		xorshift32, good enough to defeat the compressor.
+ * ----------
+ */
+static inline uint32
+pglz_adversary_random(uint32 *state)
+{
+	uint32		x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+
+static void
+pglz_generate_rnd(unsigned char *dest, int64 size)
+{
+	uint32		state = 1;
+	int64		i;
+
+	for (i = 0; i < size; i++)
+		dest[i] = (unsigned char) pglz_adversary_random(&state);
+}
+
+
+static void
+pglz_generate_runs(unsigned char *dest, int64 size)
+{
+	uint32		state = 2;
+	int64		pos = 0;
+
+	while (pos < size)
+	{
+		int64		len = Min(1024 + pglz_adversary_random(&state) % 3072,
+							  size - pos);
+
+		memset(dest + pos, (unsigned char) pglz_adversary_random(&state), len);
+		pos += len;
+	}
+}
+
+
+static void
+pglz_generate_offset1(unsigned char *dest, int64 size)
+{
+	uint32		state = 3;
+	int64		pos = 0;
+
+	while (pos < size)
+	{
+		/* a literal and 3 to 17 copies of it */
+		int64		len = Min(4 + pglz_adversary_random(&state) % 15,
+							  size - pos);
+
+		memset(dest + pos, (unsigned char) pglz_adversary_random(&state), len);
+		pos += len;
+	}
+}
+
+
+static void
+pglz_generate_offset2(unsigned char *dest, int64 size)
+{
+	uint32		state = 4;
+	int64		pos = 0;
+
+	while (pos < size)
+	{
+		/* two literals and 3 to 17 more bytes of their pattern */
+		int64		len = Min(5 + pglz_adversary_random(&state) % 15,
+							  size - pos);
+		uint32		r = pglz_adversary_random(&state);
+		int64		i;
+
+		for (i = 0; i < len; i++)
+			dest[pos + i] = (unsigned char) (i & 1 ? r : r >> 8);
+		pos += len;
+	}
+}
+
+
+static void
+pglz_generate_maxmatch(unsigned char *dest, int64 size)
+{
+	int64		block = Min(1021, size);
+	int64		pos;
+
+	pglz_generate_rnd(dest, block);
+	for (pos = block; pos < size; pos++)
+		dest[pos] = dest[pos - block];
+}
+
+
+static void
+pglz_generate_collisions(unsigned char *dest, int64 size)
+{
+	uint32		state = 6;
+	int64		pos = 0;
+
+	while (pos < size)
+	{
+		unsigned char group[4];
+		uint32		rest;
+		uint32		r = pglz_adversary_random(&state);
+
+		/*
+		 * A repeat gives a match of 4 bytes, rarely more, far below
+		 * good_match, so the lookup goes on down the chain.  The matches
+		 * also keep the output under the limit of the default strategy and
+		 * count as the first success.
+		 */
+		if (pos >= 4 && r % 8 != 0)
+		{
+			int64		back = 1 + (r >> 3) % Min(pos / 4, PGLZ_ADVERSARY_REACH);
+
+			memcpy(dest + pos, dest + pos - 4 * back, Min(4, size - pos));
+			pos += 4;
+			continue;
+		}
+
+		/*
+		 * The last byte only reaches the low 8 bits of the slot, so draw
+		 * the others until they get the upper bits right.
+		 */
+		do
+		{
+			r = pglz_adversary_random(&state);
+			group[0] = (unsigned char) r;
+			group[1] = (unsigned char) (r >> 8);
+			group[2] = (unsigned char) (r >> 16);
+			rest = (PGLZ_ADVERSARY_SLOT ^ (group[0] << 6) ^ (group[1] << 4) ^
+					(group[2] << 2)) & PGLZ_ADVERSARY_MASK;
+		} while (rest > 0xff);
+		group[3] = (unsigned char) rest;
+
+		memcpy(dest + pos, group, Min(4, size - pos));
+		pos += 4;
+	}
+}
+
+
+const PGLZ_Adversary pglz_adversaries[] =
+{
+	{"adversary_rnd", pglz_generate_rnd},
+	{"adversary_runs", pglz_generate_runs},
+	{"adversary_offset1", pglz_generate_offset1},
+	{"adversary_offset2", pglz_generate_offset2},
+	{"adversary_maxmatch", pglz_generate_maxmatch},
+	{"adversary_collisions", pglz_generate_collisions},
+};
+const int	pglz_adversaries_count = lengthof(pglz_adversaries);
@@ -0,0 +1,279 @@
+/* ----------
+ * pg_lzcompress_auto.c -
+ *
+ *		Decompressor that runs the fastest kernel for this CPU.
+ *
+ *		Which of the decompressors is fastest depends on the
+ *		microarchitecture, so one binary built for many machines cannot
+ *		pick it at compile time.  Instead every decompressor of the
+ *		registry that keeps the pglz_decompress() contract and can run on
+ *		this CPU gets timed on a synthetic sample once, and the fastest one
+ *		is bound to a function pointer.  New kernels take part as soon as
+ *		they are registered.
+ *
+ *		Entry routines:
+ *
+ *			void
+ *			pglz_decompress_auto_init(void)
+ *
+ *				Times the candidates and binds the winner.  Meant to be
+ *				called from _PG_init(), before any other thread may call
+ *				pglz_decompress_auto().  Calling it again repeats the
+ *				measurement.
+ *
+ *			int32
+ *			pglz_decompress_auto(const char *source, int32 slen,
+ *								 char *dest, int32 rawsize,
+ *								 bool check_complete)
+ *
+ *				Same contract as pglz_decompress().  Initializes itself on
+ *				first use if pglz_decompress_auto_init() was not called.
+ *
+ *			const char *
+ *			pglz_decompress_auto_name(void)
+ *
+ *				Registry name of the decompressor chosen, NULL before
+ *				initialization.
+ *
+ *		The measurement does not palloc or elog and compresses its sample
+ *		in a context of its own.  On first use it runs under pthread_once()
+ *		and leaves the function pointer alone, so a batch helper thread may
+ *		be the first caller of pglz_decompress_auto(); such callers keep
+ *		paying for the pthread_once() check.  pglz_decompress_auto_init()
+ *		itself must not overlap with any other call.
+ *
+ * Copyright (c) 1999-2019, PostgreSQL Global Development Group
+ *
+ * contrib/test_pglz/pg_lzcompress_auto.c
+ * ----------
+ */
+#include "postgres.h"
+
+#include <pthread.h>
+
+#include "common/pg_lzcompress.h"
+#include "pg_lzcompress_hacked.h"
+#include "portability/instr_time.h"
+
+
+/* Size of the calibration sample and number of timed runs per candidate */
+#define PGLZ_AUTO_SAMPLE_SIZE	65536
+#define PGLZ_AUTO_ROUNDS		5
+
+static int32 pglz_decompress_auto_choose(const char *source, int32 slen,
+										 char *dest, int32 rawsize,
+										 bool check_complete);
+
+static PGLZ_DecompressFunc pglz_decompress_auto_impl =
+	pglz_decompress_auto_choose;
+static PGLZ_DecompressFunc pglz_decompress_auto_best = NULL;
+static const char *pglz_decompress_auto_chosen = NULL;
+static pthread_once_t pglz_decompress_auto_once = PTHREAD_ONCE_INIT;
+
+
+/* ----------
+ * pglz_auto_fill_sample -
+ *
+ *		Fills sample with deterministic data that has about the mix of
+ *		literals, short-offset runs and long matches of ordinary text and
+ *		tuple data.
+ * ----------
+ */
+static void
+pglz_auto_fill_sample(unsigned char *sample, int32 size)
+{
+	static const char *const words[] = {
+		"the ", "of ", "and ", "to ", "in ", "tuple ", "page ", "index ",
+		"relation ", "transaction ", "0000000", "    ", "\n", ", ", "id=",
+		"compression "
+	};
+	uint32		seed = 0x9e3779b9;
+	int32		pos = 0;
+
+	while (pos < size)
+	{
+		uint32		r;
+
+		seed = seed * 1103515245 + 12345;
+		r = seed >> 16;
+
+		if ((r & 7) == 0)
+		{
+			/* a few random bytes */
+			int32		n = Min(1 + (int32) (r >> 3) % 8, size - pos);
+
+			while (n-- > 0)
+			{
+				seed = seed * 1103515245 + 12345;
+				sample[pos++] = (unsigned char) (seed >> 24);
+			}
+		}
+		else if ((r & 7) == 1)
+		{
+			/* a run of one byte, which becomes a match with offset 1 */
+			int32		n = Min(4 + (int32) (r >> 3) % 60, size - pos);
+
+			memset(sample + pos, 'a' + (r >> 9) % 26, n);
+			pos += n;
+		}
+		else
+		{
+			const char *word = words[(r >> 3) % lengthof(words)];
+			int32		n = Min((int32) strlen(word), size - pos);
+
+			memcpy(sample + pos, word, n);
+			pos += n;
+		}
+	}
+}
+
+
+/* ----------
+ * pglz_decompress_auto_measure -
+ *
+ *		Finds the fastest usable decompressor and stores it in
+ *		pglz_decompress_auto_best.  pglz_decompress_hacked() is the
+ *		fallback should anything go wrong.
+ * ----------
+ */
+static void
+pglz_decompress_auto_measure(void)
+{
+	PGLZ_DecompressFunc best = pglz_decompress_hacked;
+	const char *best_name = "pglz_decompress_hacked";
+	double		best_time = -1;
+	PGLZ_CompressContext *ctx;
+	unsigned char *sample;
+	char	   *compressed;
+	char	   *output;
+	int32		clen;
+	int			i;
+
+	ctx = malloc(sizeof(PGLZ_CompressContext));
+	sample = malloc(PGLZ_AUTO_SAMPLE_SIZE);
+	compressed = malloc(PGLZ_MAX_OUTPUT(PGLZ_AUTO_SAMPLE_SIZE));
+	output = malloc(PGLZ_AUTO_SAMPLE_SIZE);
+	if (ctx == NULL || sample == NULL || compressed == NULL || output == NULL)
+		goto done;
+
+	/* not pglz_compress_hacked(), whose context other threads may be using */
+	pglz_compress_context_init(ctx);
+	pglz_auto_fill_sample(sample, PGLZ_AUTO_SAMPLE_SIZE);
+	clen = pglz_compress_hacked_ctx(ctx, (const char *) sample,
+									PGLZ_AUTO_SAMPLE_SIZE, compressed,
+									PGLZ_strategy_always);
+	if (clen < 0)
+		goto done;
+
+	for (i = 0; i < pglz_decompressors_count; i++)
+	{
+		const PGLZ_Codec *codec = &pglz_decompressors[i];
+		double		codec_time = -1;
+		int			round;
+
+		/* candidates must not need more than the caller's rawsize bytes */
+		if (codec->decompress == pglz_decompress_auto ||
+			codec->dest_slack != 0 ||
+			!pglz_codec_usable(codec))
+			continue;
+
+		for (round = 0; round < PGLZ_AUTO_ROUNDS; round++)
+		{
+			instr_time	begin;
+			instr_time	end;
+			int32		result;
+
+			INSTR_TIME_SET_CURRENT(begin);
+			result = codec->decompress(compressed, clen, output,
+									   PGLZ_AUTO_SAMPLE_SIZE, true);
+			INSTR_TIME_SET_CURRENT(end);
+			INSTR_TIME_SUBTRACT(end, begin);
+
+			/* a kernel that gets the sample wrong is never chosen */
+			if (result != PGLZ_AUTO_SAMPLE_SIZE ||
+				memcmp(output, sample, PGLZ_AUTO_SAMPLE_SIZE) != 0)
+			{
+				codec_time = -1;
+				break;
+			}
+			if (codec_time < 0 || INSTR_TIME_GET_DOUBLE(end) < codec_time)
+				codec_time = INSTR_TIME_GET_DOUBLE(end);
+		}
+
+		if (codec_time >= 0 && (best_time < 0 || codec_time < best_time))
+		{
+			best = codec->decompress;
+			best_name = codec->name;
+			best_time = codec_time;
+		}
+	}
+
+done:
+	free(ctx);
+	free(sample);
+	free(compressed);
+	free(output);
+
+	pglz_decompress_auto_best = best;
+	pglz_decompress_auto_chosen = best_name;
+}
+
+
+/* ----------
+ * pglz_decompress_auto_init -
+ *
+ *		Binds pglz_decompress_auto() to the fastest usable decompressor.
+ * ----------
+ */
+void
+pglz_decompress_auto_init(void)
+{
+	pglz_decompress_auto_measure();
+	pglz_decompress_auto_impl = pglz_decompress_auto_best;
+}
+
+
+/*
+ * This gets called on every call if pglz_decompress_auto_init() was not.
+ * Threads that get here at the same time wait in pthread_once() until the
+ * one doing the measurement is done.  The function pointer is not replaced,
+ * since other threads may be reading it.
+ */
+static int32
+pglz_decompress_auto_choose(const char *source, int32 slen, char *dest,
+							int32 rawsize, bool check_complete)
+{
+	pthread_once(&pglz_decompress_auto_once, pglz_decompress_auto_measure);
+
+	return pglz_decompress_auto_best(source, slen, dest, rawsize,
+									 check_complete);
+}
+
+
+/* ----------
+ * pglz_decompress_auto -
+ *
+ *		Decompresses source into dest with the decompressor chosen for
+ *		this CPU.
+ * ----------
+ */
+int32
+pglz_decompress_auto(const char *source, int32 slen, char *dest,
+					 int32 rawsize, bool check_complete)
+{
+	return pglz_decompress_auto_impl(source, slen, dest, rawsize,
+									 check_complete);
+}
+
+
+/* ----------
+ * pglz_decompress_auto_name -
+ *
+ *		Returns the registry name of the chosen decompressor.
+ * ----------
+ */
+const char *
+pglz_decompress_auto_name(void)
+{
+	return pglz_decompress_auto_chosen;
+}
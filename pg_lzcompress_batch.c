@@ -0,0 +1,489 @@
+/* ----------
+ * pg_lzcompress_batch.c -
+ *
+ *		Compression and decompression of many independent slices on
+ *		a pool of worker threads.
+ *
+ *		Entry routines:
+ *
+ *			void
+ *			pglz_compress_batch(PGLZ_Slice *slices, int nslices,
+ *								const PGLZ_Strategy *strategy,
+ *								int nthreads);
+ *
+ *				Compresses every slice with pglz_compress_hacked_ctx().
+ *				Each thread owns a PGLZ_CompressContext.
+ *
+ *			void
+ *			pglz_decompress_batch(PGLZ_Slice *slices, int nslices,
+ *								  PGLZ_DecompressFunc decompress,
+ *								  bool check_complete, int nthreads);
+ *
+ *				Decompresses every slice with the given routine.
+ *
+ *			int
+ *			pglz_decompress_pipelined(PGLZ_Slice *slices, int nslices,
+ *									  PGLZ_DecompressFunc decompress,
+ *									  bool check_complete, int distance,
+ *									  bool background);
+ *
+ *				Decompresses the slices in order in the calling thread,
+ *				and while one is decoded brings the compressed bytes of
+ *				the slice distance places ahead into the cache, so that
+ *				decoding does not stall on cold input.  Without background
+ *				the caller issues prefetches for them; with background a
+ *				helper thread reads them, staying at most distance slices
+ *				ahead.  With background returns the number of slices
+ *				whose input the helper had read before their decoding
+ *				started, else -1, as nothing tells whether a prefetch
+ *				was done in time.
+ *
+ *		The calling thread always takes part in the work, so nthreads of
+ *		1 processes all slices in the caller without any locking.  Helper
+ *		threads are started on first use and kept until the process exits.
+ *		They must never touch backend state: they do not palloc, they do
+ *		not elog, and all signals are blocked in them so that signal
+ *		handlers keep running in the backend's own thread.
+ *
+ *		Slices are handed out one at a time from a shared counter, which
+ *		keeps the load even when some slices turn out to be incompressible
+ *		and fail quickly.
+ *
+ * Copyright (c) 1999-2019, PostgreSQL Global Development Group
+ *
+ * contrib/test_pglz/pg_lzcompress_batch.c
+ * ----------
+ */
+#include "postgres.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+
+#include "common/pg_lzcompress.h"
+#include "pg_lzcompress_hacked.h"
+#include "port/atomics.h"
+
+
+/* Bytes between the prefetches or loads that bring a slice into the cache */
+#define PGLZ_FETCH_STRIDE	64
+
+#if defined(__GNUC__)
+#define pglz_prefetch(p)	__builtin_prefetch(p)
+#else
+#define pglz_prefetch(p)	((void) 0)
+#endif
+
+
+/* ----------
+ * PGLZ_BatchJob -
+ *
+ *		The batch currently being processed by the pool.
+ * ----------
+ */
+typedef struct PGLZ_BatchJob
+{
+	bool		compress;
+	PGLZ_Slice *slices;
+	int			nslices;
+	const PGLZ_Strategy *strategy;
+	PGLZ_DecompressFunc decompress;
+	bool		check_complete;
+	int			nthreads;		/* threads taking part, caller included */
+	pg_atomic_uint32 next_slice;	/* first slice nobody has claimed yet */
+
+	/* Only for pglz_decompress_pipelined() */
+	bool		pipelined;
+	int			distance;
+	int		   *fetched_ahead;	/* the result */
+	pg_atomic_uint32 decoded;	/* slices the caller has decoded */
+	pg_atomic_uint32 fetched;	/* slices the helper has read */
+} PGLZ_BatchJob;
+
+
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t batch_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t batch_done = PTHREAD_COND_INITIALIZER;
+
+/* All of these are protected by batch_lock */
+static PGLZ_BatchJob batch_job;
+static uint64 batch_generation = 0;
+static int	batch_helpers_busy = 0;
+
+/* Only touched by the thread that calls the entry routines */
+static int	helper_count = 0;
+static pthread_t helpers[PGLZ_BATCH_MAX_THREADS];
+static PGLZ_CompressContext *contexts[PGLZ_BATCH_MAX_THREADS];
+
+/* Where the helper's loads go, so that they are not optimized away */
+static volatile unsigned char fetch_sink;
+
+
+/* ----------
+ * pglz_prefetch_slice -
+ *
+ *		Issues prefetches for the compressed bytes of a slice.
+ * ----------
+ */
+static inline void
+pglz_prefetch_slice(const PGLZ_Slice *slice)
+{
+	int32		off;
+
+	for (off = 0; off < slice->slen; off += PGLZ_FETCH_STRIDE)
+		pglz_prefetch(slice->source + off);
+}
+
+
+/* ----------
+ * pglz_pipeline_decode -
+ *
+ *		The caller's part of a pipelined job: decodes the slices in order.
+ * ----------
+ */
+static void
+pglz_pipeline_decode(PGLZ_BatchJob *job)
+{
+	bool		prefetch = job->nthreads == 1 && job->distance > 0;
+	int			ahead = 0;
+	int			i;
+
+	/* the first slices have nothing before them to overlap with */
+	if (prefetch)
+	{
+		for (i = 0; i < job->distance && i < job->nslices; i++)
+			pglz_prefetch_slice(&job->slices[i]);
+	}
+
+	for (i = 0; i < job->nslices; i++)
+	{
+		PGLZ_Slice *slice = &job->slices[i];
+
+		if (job->nthreads > 1)
+		{
+			if ((int) pg_atomic_read_u32(&job->fetched) > i)
+				ahead++;
+		}
+		else if (prefetch && i + job->distance < job->nslices)
+			pglz_prefetch_slice(&job->slices[i + job->distance]);
+
+		slice->result = job->decompress(slice->source, slice->slen,
+										slice->dest, slice->rawsize,
+										job->check_complete);
+		pg_atomic_write_u32(&job->decoded, i + 1);
+	}
+
+	*job->fetched_ahead = job->nthreads > 1 ? ahead : -1;
+}
+
+
+/* ----------
+ * pglz_pipeline_fetch -
+ *
+ *		The helper's part of a pipelined job: reads the input of the slices
+ *		ahead of the caller, which puts it in the shared cache.  Staying
+ *		within distance slices keeps it from being evicted again before the
+ *		caller gets there.
+ * ----------
+ */
+static void
+pglz_pipeline_fetch(PGLZ_BatchJob *job)
+{
+	uint32		nslices = job->nslices;
+	uint32		i = 0;
+	uint32		spins = 0;
+	unsigned char sum = 0;
+
+	while (i < nslices)
+	{
+		uint32		decoded = pg_atomic_read_u32(&job->decoded);
+		const unsigned char *source;
+		int32		off;
+
+		if (i < decoded)
+		{
+			/* too late for these */
+			i = decoded;
+			continue;
+		}
+		if (i >= decoded + job->distance)
+		{
+			/* give way to the caller if it has to share a CPU with us */
+			if (++spins % 1024 == 0)
+				sched_yield();
+			else
+				pg_spin_delay();
+			continue;
+		}
+
+		source = (const unsigned char *) job->slices[i].source;
+		for (off = 0; off < job->slices[i].slen; off += PGLZ_FETCH_STRIDE)
+			sum += source[off];
+		pg_atomic_write_u32(&job->fetched, ++i);
+	}
+
+	fetch_sink = sum;
+}
+
+
+/* ----------
+ * pglz_batch_run -
+ *
+ *		Claims and processes slices of the current job until none are left.
+ *		thread_id selects the history context for compression.
+ * ----------
+ */
+static void
+pglz_batch_run(PGLZ_BatchJob *job, int thread_id)
+{
+	uint32		nslices = job->nslices;
+	uint32		i;
+
+	if (job->pipelined)
+	{
+		if (thread_id == 0)
+			pglz_pipeline_decode(job);
+		else
+			pglz_pipeline_fetch(job);
+		return;
+	}
+
+	while ((i = pg_atomic_fetch_add_u32(&job->next_slice, 1)) < nslices)
+	{
+		PGLZ_Slice *slice = &job->slices[i];
+
+		if (job->compress)
+			slice->result = pglz_compress_hacked_ctx(contexts[thread_id],
+													 slice->source,
+													 slice->slen,
+													 slice->dest,
+													 job->strategy);
+		else
+			slice->result = job->decompress(slice->source, slice->slen,
+											slice->dest, slice->rawsize,
+											job->check_complete);
+	}
+}
+
+
+/* ----------
+ * pglz_batch_helper -
+ *
+ *		Main loop of a helper thread: wait for a new job, help with it if
+ *		the job asked for this many threads, report back.
+ * ----------
+ */
+static void *
+pglz_batch_helper(void *arg)
+{
+	int			thread_id = (int) (intptr_t) arg;
+	uint64		seen_generation = 0;
+
+	/*
+	 * Do not start from the current generation: the job this helper was
+	 * started for may already have been published by the time we get here.
+	 * Jobs published before the helper existed never ask for it, so they
+	 * are skipped below.
+	 */
+	pthread_mutex_lock(&batch_lock);
+	for (;;)
+	{
+		while (batch_generation == seen_generation)
+			pthread_cond_wait(&batch_start, &batch_lock);
+		seen_generation = batch_generation;
+
+		if (thread_id >= batch_job.nthreads)
+			continue;
+		pthread_mutex_unlock(&batch_lock);
+
+		pglz_batch_run(&batch_job, thread_id);
+#ifdef PGLZ_STATS
+		/* before the caller can learn that the batch is done */
+		pglz_stats_flush();
+#endif
+
+		pthread_mutex_lock(&batch_lock);
+		if (--batch_helpers_busy == 0)
+			pthread_cond_signal(&batch_done);
+	}
+
+	return NULL;
+}
+
+
+/* ----------
+ * pglz_batch_prepare -
+ *
+ *		Makes sure there are contexts and helper threads for nthreads
+ *		threads.  Returns the number of threads that can actually be used,
+ *		which is less than asked for if the system refuses to start more.
+ * ----------
+ */
+static int
+pglz_batch_prepare(int nthreads, bool compress)
+{
+	int			i;
+
+	nthreads = Max(nthreads, 1);
+	nthreads = Min(nthreads, PGLZ_BATCH_MAX_THREADS);
+
+	if (compress)
+	{
+		for (i = 0; i < nthreads; i++)
+		{
+			if (contexts[i] != NULL)
+				continue;
+			contexts[i] = malloc(sizeof(PGLZ_CompressContext));
+			if (contexts[i] == NULL)
+				elog(ERROR, "out of memory for pglz compression context");
+			pglz_compress_context_init(contexts[i]);
+		}
+	}
+
+	if (helper_count + 1 < nthreads)
+	{
+		sigset_t	all_signals;
+		sigset_t	old_signals;
+
+		sigfillset(&all_signals);
+		pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+		while (helper_count + 1 < nthreads)
+		{
+			/*
+			 * The helper picks its id from the argument, and ids start at 1:
+			 * id 0 is the calling thread.
+			 */
+			if (pthread_create(&helpers[helper_count], NULL, pglz_batch_helper,
+							   (void *) (intptr_t) (helper_count + 1)) != 0)
+				break;
+			helper_count++;
+		}
+		pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+	}
+
+	return Min(nthreads, helper_count + 1);
+}
+
+
+/* ----------
+ * pglz_batch_execute -
+ *
+ *		Publishes the job to the helpers, does a share of the work in the
+ *		calling thread and waits for all helpers to finish.
+ * ----------
+ */
+static void
+pglz_batch_execute(PGLZ_BatchJob *job)
+{
+	if (job->nthreads == 1)
+	{
+		pg_atomic_init_u32(&job->next_slice, 0);
+		pg_atomic_init_u32(&job->decoded, 0);
+		pg_atomic_init_u32(&job->fetched, 0);
+		pglz_batch_run(job, 0);
+		return;
+	}
+
+	pthread_mutex_lock(&batch_lock);
+	batch_job = *job;
+	pg_atomic_init_u32(&batch_job.next_slice, 0);
+	pg_atomic_init_u32(&batch_job.decoded, 0);
+	pg_atomic_init_u32(&batch_job.fetched, 0);
+	batch_helpers_busy = job->nthreads - 1;
+	batch_generation++;
+	pthread_cond_broadcast(&batch_start);
+	pthread_mutex_unlock(&batch_lock);
+
+	pglz_batch_run(&batch_job, 0);
+
+	pthread_mutex_lock(&batch_lock);
+	while (batch_helpers_busy > 0)
+		pthread_cond_wait(&batch_done, &batch_lock);
+	pthread_mutex_unlock(&batch_lock);
+}
+
+
+/* ----------
+ * pglz_compress_batch -
+ *
+ *		Compresses all slices using up to nthreads threads.
+ * ----------
+ */
+void
+pglz_compress_batch(PGLZ_Slice *slices, int nslices,
+					const PGLZ_Strategy *strategy, int nthreads)
+{
+	PGLZ_BatchJob job;
+
+	job.compress = true;
+	job.slices = slices;
+	job.nslices = nslices;
+	job.strategy = strategy;
+	job.decompress = NULL;
+	job.check_complete = false;
+	job.pipelined = false;
+	job.nthreads = pglz_batch_prepare(Min(nthreads, nslices), true);
+
+	pglz_batch_execute(&job);
+}
+
+
+/* ----------
+ * pglz_decompress_batch -
+ *
+ *		Decompresses all slices with the given routine using up to
+ *		nthreads threads.
+ * ----------
+ */
+void
+pglz_decompress_batch(PGLZ_Slice *slices, int nslices,
+					  PGLZ_DecompressFunc decompress, bool check_complete,
+					  int nthreads)
+{
+	PGLZ_BatchJob job;
+
+	job.compress = false;
+	job.slices = slices;
+	job.nslices = nslices;
+	job.strategy = NULL;
+	job.decompress = decompress;
+	job.check_complete = check_complete;
+	job.pipelined = false;
+	job.nthreads = pglz_batch_prepare(Min(nthreads, nslices), false);
+
+	pglz_batch_execute(&job);
+}
+
+
+/* ----------
+ * pglz_decompress_pipelined -
+ *
+ *		Decompresses all slices in order, fetching the input of the slice
+ *		distance places ahead meanwhile.  If no helper thread can be had,
+ *		background falls back to prefetches by the caller.
+ * ----------
+ */
+int
+pglz_decompress_pipelined(PGLZ_Slice *slices, int nslices,
+						  PGLZ_DecompressFunc decompress, bool check_complete,
+						  int distance, bool background)
+{
+	PGLZ_BatchJob job;
+	int			fetched_ahead = 0;
+
+	job.compress = false;
+	job.slices = slices;
+	job.nslices = nslices;
+	job.strategy = NULL;
+	job.decompress = decompress;
+	job.check_complete = check_complete;
+	job.pipelined = true;
+	job.distance = Max(distance, 0);
+	job.fetched_ahead = &fetched_ahead;
+	job.nthreads = background && distance > 0 && nslices > 1 ?
+		pglz_batch_prepare(2, false) : 1;
+
+	pglz_batch_execute(&job);
+
+	return fetched_ahead;
+}
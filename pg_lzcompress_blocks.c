@@ -0,0 +1,286 @@
+/* ----------
+ * pg_lzcompress_blocks.c -
+ *
+ *		Block-indexed container for random access into large values.
+ *
+ *		A plain pglz stream can only be decoded from its first byte, so
+ *		extracting a range near the end of a value costs as much as
+ *		decompressing all of it.  The container compresses the value in
+ *		independent blocks of block_size raw bytes, each with a history of
+ *		its own, and puts an index of where each block ends in front of
+ *		them.  Getting a range then only decodes the blocks it overlaps.
+ *
+ *		The layout, all integers in native byte order:
+ *
+ *			int32	rawsize			size of the value
+ *			int32	block_size		raw bytes per block, the last may
+ *									have less
+ *			int32	block_end[n]	end of each block's data, counted
+ *									from the end of the index
+ *			data					the blocks, each either a pglz stream
+ *									or, if it did not compress, the raw
+ *									bytes; a block is raw exactly if its
+ *									data is as long as its raw size
+ *
+ *		Entry routines:
+ *
+ *			int32
+ *			pglz_compress_blocks(const char *source, int32 slen,
+ *								 char *dest, int32 block_size,
+ *								 const PGLZ_Strategy *strategy)
+ *
+ *				Writes the container of source to dest, which must have
+ *				room for PGLZ_BLOCKS_MAX_OUTPUT(slen, block_size) bytes,
+ *				and returns its size.  Every block is compressed with
+ *				pglz_compress_hacked() and strategy.  Returns -1 if
+ *				block_size is not positive.
+ *
+ *			int32
+ *			pglz_blocks_rawsize(const char *source, int32 slen)
+ *
+ *				Size of the value in a container, -1 if there is no
+ *				valid header.
+ *
+ *			int32
+ *			pglz_decompress_range(const char *source, int32 slen,
+ *								  char *dest, int32 raw_off,
+ *								  int32 raw_len,
+ *								  PGLZ_DecompressFunc decompress)
+ *
+ *				Writes raw_len bytes of the value starting at raw_off to
+ *				dest, decoding blocks with decompress, which must not need
+ *				any dest slack.  The range is cut off at the end of the
+ *				value.  Returns the number of bytes written, or -1 if the
+ *				container is corrupt or memory for a partial first block
+ *				cannot be had.  The index is checked; the blocks are only
+ *				as safe as decompress is against malformed input.
+ *
+ *		The routines use malloc and never elog, like the batch routines.
+ *
+ * Copyright (c) 1999-2019, PostgreSQL Global Development Group
+ *
+ * contrib/test_pglz/pg_lzcompress_blocks.c
+ * ----------
+ */
+#include "postgres.h"
+
+#include "common/pg_lzcompress.h"
+#include "pg_lzcompress_hacked.h"
+
+
+/* ----------
+ * pglz_blocks_get -
+ *
+ *		Reads the index entry or header field at position i.
+ * ----------
+ */
+static inline int32
+pglz_blocks_get(const char *source, int32 i)
+{
+	int32		value;
+
+	memcpy(&value, source + i * sizeof(int32), sizeof(int32));
+	return value;
+}
+
+
+static inline void
+pglz_blocks_put(char *dest, int32 i, int32 value)
+{
+	memcpy(dest + i * sizeof(int32), &value, sizeof(int32));
+}
+
+
+/* ----------
+ * pglz_compress_blocks -
+ *
+ *		Compresses source into a block-indexed container.
+ * ----------
+ */
+int32
+pglz_compress_blocks(const char *source, int32 slen, char *dest,
+					 int32 block_size, const PGLZ_Strategy *strategy)
+{
+	int32		nblocks;
+	char	   *data;
+	int32		data_len = 0;
+	int32		i;
+
+	if (block_size <= 0 || slen < 0)
+		return -1;
+
+	nblocks = PGLZ_BLOCKS_COUNT(slen, block_size);
+	pglz_blocks_put(dest, 0, slen);
+	pglz_blocks_put(dest, 1, block_size);
+	data = dest + PGLZ_BLOCKS_INDEX_SIZE(nblocks);
+
+	for (i = 0; i < nblocks; i++)
+	{
+		int32		raw_pos = i * block_size;
+		int32		raw_len = Min(block_size, slen - raw_pos);
+		int32		clen;
+
+		/*
+		 * Each block gets an empty history, so that it can be decoded on its
+		 * own.  dest has PGLZ_MAX_OUTPUT() room for the last block only, but
+		 * all blocks before take at most their raw size.
+		 */
+		clen = pglz_compress_hacked(source + raw_pos, raw_len, data + data_len,
+									strategy);
+		if (clen < 0 || clen >= raw_len)
+		{
+			memcpy(data + data_len, source + raw_pos, raw_len);
+			clen = raw_len;
+		}
+		data_len += clen;
+		pglz_blocks_put(dest, 2 + i, data_len);
+	}
+
+	return PGLZ_BLOCKS_INDEX_SIZE(nblocks) + data_len;
+}
+
+
+/* ----------
+ * pglz_blocks_header -
+ *
+ *		Checks the header and index of the container and returns the
+ *		number of blocks, or -1 if the container is corrupt.
+ * ----------
+ */
+static int32
+pglz_blocks_header(const char *source, int32 slen, int32 *rawsize,
+				   int32 *block_size)
+{
+	int32		nblocks;
+	int32		data_len;
+	int32		prev_end = 0;
+	int32		i;
+
+	if (slen < PGLZ_BLOCKS_INDEX_SIZE(0))
+		return -1;
+	*rawsize = pglz_blocks_get(source, 0);
+	*block_size = pglz_blocks_get(source, 1);
+	if (*rawsize < 0 || *block_size <= 0)
+		return -1;
+
+	nblocks = PGLZ_BLOCKS_COUNT(*rawsize, *block_size);
+	if (nblocks > (slen - PGLZ_BLOCKS_INDEX_SIZE(0)) / (int32) sizeof(int32))
+		return -1;
+	data_len = slen - PGLZ_BLOCKS_INDEX_SIZE(nblocks);
+
+	for (i = 0; i < nblocks; i++)
+	{
+		int32		end = pglz_blocks_get(source, 2 + i);
+		int32		raw_len = Min(*block_size, *rawsize - i * *block_size);
+
+		if (end < prev_end || end > data_len || end - prev_end > raw_len)
+			return -1;
+		prev_end = end;
+	}
+
+	return nblocks;
+}
+
+
+/* ----------
+ * pglz_blocks_rawsize -
+ *
+ *		Returns the size of the value in the container.
+ * ----------
+ */
+int32
+pglz_blocks_rawsize(const char *source, int32 slen)
+{
+	int32		rawsize;
+	int32		block_size;
+
+	if (pglz_blocks_header(source, slen, &rawsize, &block_size) < 0)
+		return -1;
+	return rawsize;
+}
+
+
+/* ----------
+ * pglz_decompress_block -
+ *
+ *		Writes the first want bytes of one block to dest.
+ * ----------
+ */
+static bool
+pglz_decompress_block(const char *data, int32 clen, int32 raw_len,
+					  char *dest, int32 want, PGLZ_DecompressFunc decompress)
+{
+	if (clen == raw_len)
+	{
+		memcpy(dest, data, want);
+		return true;
+	}
+
+	return decompress(data, clen, dest, want, want == raw_len) == want;
+}
+
+
+/* ----------
+ * pglz_decompress_range -
+ *
+ *		Decompresses raw_len bytes from raw_off on out of the container.
+ * ----------
+ */
+int32
+pglz_decompress_range(const char *source, int32 slen, char *dest,
+					  int32 raw_off, int32 raw_len,
+					  PGLZ_DecompressFunc decompress)
+{
+	const char *data;
+	int32		rawsize;
+	int32		block_size;
+	int32		nblocks;
+	int32		written = 0;
+	int32		i;
+
+	nblocks = pglz_blocks_header(source, slen, &rawsize, &block_size);
+	if (nblocks < 0 || raw_off < 0 || raw_len < 0)
+		return -1;
+	if (raw_off >= rawsize)
+		return 0;
+	raw_len = Min(raw_len, rawsize - raw_off);
+	data = source + PGLZ_BLOCKS_INDEX_SIZE(nblocks);
+
+	for (i = raw_off / block_size; written < raw_len; i++)
+	{
+		int32		start = i == 0 ? 0 : pglz_blocks_get(source, 2 + i - 1);
+		int32		clen = pglz_blocks_get(source, 2 + i) - start;
+		int32		block_raw_len = Min(block_size, rawsize - i * block_size);
+		int32		skip = raw_off + written - i * block_size;
+		int32		want = Min(block_raw_len - skip, raw_len - written);
+
+		if (skip == 0)
+		{
+			/* the block's prefix goes straight to its place */
+			if (!pglz_decompress_block(data + start, clen, block_raw_len,
+									   dest + written, want, decompress))
+				return -1;
+		}
+		else if (clen == block_raw_len)
+			memcpy(dest + written, data + start + skip, want);
+		else
+		{
+			/* decode what comes before the range too, then drop it */
+			char	   *buf = malloc(skip + want);
+			bool		ok;
+
+			if (buf == NULL)
+				return -1;
+			ok = pglz_decompress_block(data + start, clen, block_raw_len,
+									   buf, skip + want, decompress);
+			if (ok)
+				memcpy(dest + written, buf + skip, want);
+			free(buf);
+			if (!ok)
+				return -1;
+		}
+		written += want;
+	}
+
+	return written;
+}
@@ -0,0 +1,96 @@
+/* ----------
+ * pg_lzcompress_codecs.c -
+ *
+ *		The registry of all compressors and decompressors.
+ *
+ *		Every codec is listed exactly once, together with its name and
+ *		what it needs from the CPU and from its caller, so the benchmarks
+ *		and the dispatchers can never attribute a result to the wrong
+ *		routine.  A new codec only has to be added here.
+ *
+ * Copyright (c) 1999-2019, PostgreSQL Global Development Group
+ *
+ * contrib/test_pglz/pg_lzcompress_codecs.c
+ * ----------
+ */
+#include "postgres.h"
+
+#include "common/pg_lzcompress.h"
+#include "pg_lzcompress_hacked.h"
+
+
+/*
+ * pglz_compress_vanilla must stay first: its output is what the
+ * decompressors are benchmarked on.
+ */
+const PGLZ_Codec pglz_compressors[] =
+{
+	{"pglz_compress_vanilla", pglz_compress_vanilla, NULL, 0, false, 0, NULL},
+	{"pglz_compress_hacked", pglz_compress_hacked, NULL, 0, false, 0,
+	pglz_compress_hacked_ctx},
+	{"pglz_compress_fast", pglz_compress_fast, NULL, 0, false, 0,
+	pglz_compress_fast_ctx},
+	{"pglz_compress_high", pglz_compress_high, NULL, 0, false, 0,
+	pglz_compress_high_ctx},
+};
+const int	pglz_compressors_count = lengthof(pglz_compressors);
+
+
+/*
+ * None of the decompressors checks tag offsets against the start of the
+ * output, so none of them is safe for untrusted input.  pglz_decompress_vanilla
+ * must stay first: it decompresses the output of every compressor in the
+ * compression benchmarks.
+ */
+const PGLZ_Codec pglz_decompressors[] =
+{
+	{"pglz_decompress_vanilla", NULL, pglz_decompress_vanilla, 0, false, 0, NULL},
+	{"pglz_decompress_hacked", NULL, pglz_decompress_hacked, 0, false, 0, NULL},
+	{"pglz_decompress_hacked_unrolled", NULL, pglz_decompress_hacked_unrolled, 0, false, 0, NULL},
+	{"pglz_decompress_hacked4", NULL, pglz_decompress_hacked4, 0, false, 0, NULL},
+	{"pglz_decompress_hacked8", NULL, pglz_decompress_hacked8, 0, false, 0, NULL},
+	{"pglz_decompress_hacked16", NULL, pglz_decompress_hacked16, 0, false, 0, NULL},
+	{"pglz_decompress_hacked32", NULL, pglz_decompress_hacked32, 0, false, 0, NULL},
+	{"pglz_decompress_hacked_runs", NULL, pglz_decompress_hacked_runs, 0, false, 0, NULL},
+	{"pglz_decompress_fast", NULL, pglz_decompress_fast, 0, false,
+	PGLZ_DECOMPRESS_FAST_SLACK, NULL},
+	{"pglz_decompress_hacked_simd", NULL, pglz_decompress_hacked_simd, 0, false, 0, NULL},
+#ifdef PGLZ_SIMD_FEATURES
+	{"pglz_decompress_hacked_shuffle", NULL, pglz_decompress_hacked_shuffle,
+	PGLZ_SIMD_FEATURES, false, 0, NULL},
+#endif
+	{"pglz_decompress_auto", NULL, pglz_decompress_auto, 0, false, 0, NULL},
+};
+const int	pglz_decompressors_count = lengthof(pglz_decompressors);
+
+
+/* ----------
+ * pglz_codec_usable -
+ *
+ *		Can codec run on this CPU?
+ * ----------
+ */
+bool
+pglz_codec_usable(const PGLZ_Codec *codec)
+{
+	return (pglz_cpu_features() & codec->cpu_features) == codec->cpu_features;
+}
+
+
+/* ----------
+ * pglz_find_codec -
+ *
+ *		Looks up a codec by name among count entries of codecs.  Returns
+ *		NULL if there is none.
+ * ----------
+ */
+const PGLZ_Codec *
+pglz_find_codec(const PGLZ_Codec *codecs, int count, const char *name)
+{
+	int			i;
+
+	for (i = 0; i < count; i++)
+		if (strcmp(codecs[i].name, name) == 0)
+			return &codecs[i];
+	return NULL;
+}
@@ -0,0 +1,442 @@
+/* ----------
+ * pg_lzcompress_dict.c -
+ *
+ *		Compression of small values against a shared dictionary.
+ *
+ *		A value of a few kB compresses poorly because the history starts
+ *		empty: most of it is spent on literals that similar values repeat
+ *		as well.  A dictionary of up to PGLZ_DICT_MAX_SIZE bytes primes the
+ *		history of the compressor and the window of the decompressor, so
+ *		that even the first bytes of a value find matches.  The compressed
+ *		format is plain pglz; the stream just has offsets that reach back
+ *		past its start into the dictionary, so it can only be decompressed
+ *		with the same dictionary.
+ *
+ *		Entry routines:
+ *
+ *			void
+ *			pglz_dict_load(PGLZ_Dictionary *dict, const char *data,
+ *						   int32 size)
+ *
+ *				Makes a dictionary of user-supplied data.  Of data longer
+ *				than PGLZ_DICT_MAX_SIZE the end is kept, since matches near
+ *				the end are the cheapest to find.
+ *
+ *			int32
+ *			pglz_dict_train(PGLZ_Dictionary *dict, const char *samples,
+ *							const int32 *sample_sizes, int nsamples,
+ *							int32 dict_size)
+ *
+ *				Builds a dictionary of at most dict_size bytes from the
+ *				concatenated samples, picking the pieces that occur in the
+ *				most samples.  Returns its size, which is 0 if the samples
+ *				have nothing in common or memory is short.
+ *
+ *			int32
+ *			pglz_compress_dict(const PGLZ_Dictionary *dict,
+ *							   const char *source, int32 slen, char *dest,
+ *							   const PGLZ_Strategy *strategy)
+ *
+ *				Same contract as pglz_compress_hacked(), with the history
+ *				primed by dict.  Also fails if memory is short, in which
+ *				case the caller stores the value raw as for any failure.
+ *				pglz_compress_dict_ctx() takes a context of its own.
+ *
+ *			int32
+ *			pglz_decompress_dict(const PGLZ_Dictionary *dict,
+ *								 const char *source, int32 slen,
+ *								 char *dest, int32 rawsize,
+ *								 bool check_complete)
+ *
+ *				Same contract as pglz_decompress().  A tag reaching back
+ *				past the start of dest copies from the end of dict; one
+ *				reaching past that as well, one with offset 0, or one cut
+ *				off at the end of the input makes it return -1, so that it
+ *				never reads outside source and dict or writes outside dest.
+ *
+ *		Nothing here pallocs or elogs, like the batch routines.
+ *
+ * Copyright (c) 1999-2019, PostgreSQL Global Development Group
+ *
+ * contrib/test_pglz/pg_lzcompress_dict.c
+ * ----------
+ */
+#include "postgres.h"
+
+#include "common/pg_lzcompress.h"
+#include "pg_lzcompress_hacked.h"
+
+
+/*
+ * The trainer counts in how many samples each PGLZ_DICT_KGRAM bytes long
+ * string occurs, and scores pieces of PGLZ_DICT_SEGMENT bytes, starting
+ * every PGLZ_DICT_STEP bytes, by the counts of the strings in them.
+ */
+#define PGLZ_DICT_KGRAM			8
+#define PGLZ_DICT_SEGMENT		64
+#define PGLZ_DICT_STEP			16
+#define PGLZ_DICT_HASH_BITS		20
+
+/* Compression context used by pglz_compress_dict() */
+static PGLZ_CompressContext dict_context;
+
+
+/* ----------
+ * pglz_dict_load -
+ *
+ *		Copies data into dict.
+ * ----------
+ */
+void
+pglz_dict_load(PGLZ_Dictionary *dict, const char *data, int32 size)
+{
+	if (size > PGLZ_DICT_MAX_SIZE)
+	{
+		data += size - PGLZ_DICT_MAX_SIZE;
+		size = PGLZ_DICT_MAX_SIZE;
+	}
+	memcpy(dict->data, data, Max(size, 0));
+	dict->size = Max(size, 0);
+}
+
+
+/* ----------
+ * pglz_compress_dict_ctx -
+ *
+ *		Compresses source against dict.  The compressor can only refer to
+ *		bytes before the source in memory, so the dictionary and the source
+ *		are put next to each other first.
+ * ----------
+ */
+int32
+pglz_compress_dict_ctx(PGLZ_CompressContext *ctx, const PGLZ_Dictionary *dict,
+					   const char *source, int32 slen, char *dest,
+					   const PGLZ_Strategy *strategy)
+{
+	char	   *buf;
+	int32		result;
+
+	buf = malloc(dict->size + Max(slen, 0));
+	if (buf == NULL)
+		return -1;
+	memcpy(buf, dict->data, dict->size);
+	memcpy(buf + dict->size, source, Max(slen, 0));
+
+	result = pglz_compress_primed_ctx(ctx, buf + dict->size, slen, dest,
+									  strategy, dict->size);
+	free(buf);
+
+	return result;
+}
+
+
+int32
+pglz_compress_dict(const PGLZ_Dictionary *dict, const char *source,
+				   int32 slen, char *dest, const PGLZ_Strategy *strategy)
+{
+	return pglz_compress_dict_ctx(&dict_context, dict, source, slen, dest,
+								  strategy);
+}
+
+
+/* ----------
+ * pglz_decompress_dict -
+ *
+ *		pglz_decompress_hacked() with the window extended into dict.
+ * ----------
+ */
+int32
+pglz_decompress_dict(const PGLZ_Dictionary *dict, const char *source,
+					 int32 slen, char *dest, int32 rawsize,
+					 bool check_complete)
+{
+	const unsigned char *sp;
+	const unsigned char *srcend;
+	unsigned char *dp;
+	unsigned char *destend;
+	const unsigned char *dictend;
+
+	sp = (const unsigned char *) source;
+	srcend = ((const unsigned char *) source) + slen;
+	dp = (unsigned char *) dest;
+	destend = dp + rawsize;
+	dictend = (const unsigned char *) dict->data + dict->size;
+
+	while (sp < srcend && dp < destend)
+	{
+		/*
+		 * Read one control byte and process the next 8 items (or as many as
+		 * remain in the compressed input).
+		 */
+		unsigned char ctrl = *sp++;
+		int			ctrlc;
+
+		for (ctrlc = 0; ctrlc < 8 && sp < srcend && dp < destend; ctrlc++)
+		{
+			if (ctrl & 1)
+			{
+				int32		len;
+				int32		off;
+
+				if (srcend - sp < 2)
+					return -1;
+				len = (sp[0] & 0x0f) + 3;
+				off = ((sp[0] & 0xf0) << 4) | sp[1];
+				sp += 2;
+				if (len == 18)
+				{
+					if (sp >= srcend)
+						return -1;
+					len += *sp++;
+				}
+				len = Min(len, destend - dp);
+
+				/*
+				 * The part of the match that lies before dest comes from the
+				 * dictionary.  After it the match continues exactly at the
+				 * start of dest.
+				 */
+				if (unlikely(off == 0 || off > dp - (unsigned char *) dest))
+				{
+					int32		back = off - (dp - (unsigned char *) dest);
+					int32		n = Min(back, len);
+
+					if (off == 0 || back > dict->size)
+						return -1;
+					memcpy(dp, dictend - back, n);
+					dp += n;
+					len -= n;
+				}
+
+				/*
+				 * Now we copy the bytes specified by the tag from OUTPUT to
+				 * OUTPUT, in pieces that do not overlap.
+				 */
+				while (off < len)
+				{
+					memcpy(dp, dp - off, off);
+					len -= off;
+					dp += off;
+					off += off;
+				}
+				memcpy(dp, dp - off, len);
+				dp += len;
+			}
+			else
+			{
+				/*
+				 * An unset control bit means LITERAL BYTE. So we just copy
+				 * one from INPUT to OUTPUT.
+				 */
+				*dp++ = *sp++;
+			}
+
+			/*
+			 * Advance the control bit
+			 */
+			ctrl >>= 1;
+		}
+	}
+
+	/*
+	 * Check we decompressed the right amount.
+	 */
+	if (check_complete && (dp != destend || sp != srcend))
+		return -1;
+
+	return (char *) dp - dest;
+}
+
+
+/* ----------
+ * pglz_dict_hash -
+ *
+ *		Slot of the PGLZ_DICT_KGRAM bytes at s in the trainer's counts.
+ * ----------
+ */
+static inline uint32
+pglz_dict_hash(const unsigned char *s)
+{
+	uint64		x;
+
+	memcpy(&x, s, sizeof(x));
+	return (uint32) ((x * UINT64CONST(0x9E3779B97F4A7C15)) >>
+					 (64 - PGLZ_DICT_HASH_BITS));
+}
+
+
+/* ----------
+ * PGLZ_DictCandidate -
+ *
+ *		A piece of the samples the trainer may put into the dictionary.
+ * ----------
+ */
+typedef struct PGLZ_DictCandidate
+{
+	int64		score;
+	int64		pos;			/* into the concatenated samples */
+	int32		len;
+} PGLZ_DictCandidate;
+
+
+/* ----------
+ * pglz_dict_score -
+ *
+ *		Sum of the counts of the strings in a candidate, each string taken
+ *		to be worth one byte per further sample it occurs in.
+ * ----------
+ */
+static int64
+pglz_dict_score(const unsigned char *samples, const PGLZ_DictCandidate *c,
+				const uint32 *counts)
+{
+	int64		score = 0;
+	int32		i;
+
+	for (i = 0; i + PGLZ_DICT_KGRAM <= c->len; i++)
+	{
+		uint32		count = counts[pglz_dict_hash(samples + c->pos + i)];
+
+		if (count > 1)
+			score += count - 1;
+	}
+	return score;
+}
+
+
+/*
+ * Max-heap of candidates by score, for the lazy greedy selection.
+ */
+static void
+pglz_dict_sift_down(PGLZ_DictCandidate *heap, int64 n, int64 i)
+{
+	for (;;)
+	{
+		int64		largest = i;
+		int64		l = 2 * i + 1;
+		int64		r = l + 1;
+		PGLZ_DictCandidate tmp;
+
+		if (l < n && heap[l].score > heap[largest].score)
+			largest = l;
+		if (r < n && heap[r].score > heap[largest].score)
+			largest = r;
+		if (largest == i)
+			return;
+		tmp = heap[i];
+		heap[i] = heap[largest];
+		heap[largest] = tmp;
+		i = largest;
+	}
+}
+
+
+/* ----------
+ * pglz_dict_train -
+ *
+ *		Greedy selection of the pieces of the samples whose strings are
+ *		shared by the most samples.  After a piece is taken its strings
+ *		count no more, so that the dictionary does not repeat itself.
+ *		Scores only go down, so the scores in the heap are upper bounds,
+ *		and a candidate on top whose score has not changed is the best.
+ *		The best pieces go to the end of the dictionary, next to the
+ *		value, where the history looks first.
+ * ----------
+ */
+int32
+pglz_dict_train(PGLZ_Dictionary *dict, const char *samples,
+				const int32 *sample_sizes, int nsamples, int32 dict_size)
+{
+	const unsigned char *sp = (const unsigned char *) samples;
+	uint32	   *counts;
+	int32	   *last_sample;
+	PGLZ_DictCandidate *heap;
+	int64		total = 0;
+	int64		ncandidates = 0;
+	int64		pos;
+	int32		filled = 0;
+	int			s;
+
+	dict->size = 0;
+	dict_size = Min(Max(dict_size, 0), PGLZ_DICT_MAX_SIZE);
+	for (s = 0; s < nsamples; s++)
+		total += Max(sample_sizes[s], 0);
+
+	counts = calloc((size_t) 1 << PGLZ_DICT_HASH_BITS, sizeof(uint32));
+	last_sample = malloc(sizeof(int32) << PGLZ_DICT_HASH_BITS);
+	heap = malloc(sizeof(PGLZ_DictCandidate) *
+				  (total / PGLZ_DICT_STEP + nsamples));
+	if (counts == NULL || last_sample == NULL || heap == NULL)
+		goto done;
+	memset(last_sample, 0xff, sizeof(int32) << PGLZ_DICT_HASH_BITS);
+
+	/* count each string once per sample it occurs in, and list candidates */
+	for (s = 0, pos = 0; s < nsamples; pos += Max(sample_sizes[s], 0), s++)
+	{
+		int32		size = Max(sample_sizes[s], 0);
+		int32		i;
+
+		for (i = 0; i + PGLZ_DICT_KGRAM <= size; i++)
+		{
+			uint32		h = pglz_dict_hash(sp + pos + i);
+
+			if (last_sample[h] != s)
+			{
+				last_sample[h] = s;
+				counts[h]++;
+			}
+		}
+
+		for (i = 0; i + PGLZ_DICT_KGRAM <= size; i += PGLZ_DICT_STEP)
+		{
+			heap[ncandidates].pos = pos + i;
+			heap[ncandidates].len = Min(PGLZ_DICT_SEGMENT, size - i);
+			ncandidates++;
+		}
+	}
+
+	for (pos = 0; pos < ncandidates; pos++)
+		heap[pos].score = pglz_dict_score(sp, &heap[pos], counts);
+	for (pos = ncandidates / 2 - 1; pos >= 0; pos--)
+		pglz_dict_sift_down(heap, ncandidates, pos);
+
+	while (ncandidates > 0 && filled < dict_size)
+	{
+		PGLZ_DictCandidate best = heap[0];
+		int64		score = pglz_dict_score(sp, &best, counts);
+		int32		len;
+		int32		i;
+
+		if (score < best.score)
+		{
+			/* its score went down, let it sink and look again */
+			heap[0].score = score;
+			pglz_dict_sift_down(heap, ncandidates, 0);
+			continue;
+		}
+		if (score <= 0)
+			break;
+
+		heap[0] = heap[--ncandidates];
+		pglz_dict_sift_down(heap, ncandidates, 0);
+
+		len = Min(best.len, dict_size - filled);
+		memcpy(dict->data + dict_size - filled - len,
+			   sp + best.pos + best.len - len, len);
+		filled += len;
+
+		for (i = 0; i + PGLZ_DICT_KGRAM <= best.len; i++)
+			counts[pglz_dict_hash(sp + best.pos + i)] = 0;
+	}
+
+	/* move what was filled in from the end to the start */
+	memmove(dict->data, dict->data + dict_size - filled, filled);
+	dict->size = filled;
+
+done:
+	free(counts);
+	free(last_sample);
+	free(heap);
+
+	return dict->size;
+}
@@ -3,6 +3,7 @@
 #include <limits.h>
 
 #include "common/pg_lzcompress.h"
+#include "pg_lzcompress_hacked.h"
 
 int32
 pglz_decompress_hacked(const char *source, int32 slen, char *dest,
@@ -18,6 +19,8 @@ pglz_decompress_hacked(const char *source, int32 slen, char *dest,
 	dp = (unsigned char *) dest;
 	destend = dp + rawsize;
 
+	PGLZ_STATS_ADD(decompress_calls, 1);
+
 	while (sp < srcend && dp < destend)
 	{
 		/*
@@ -55,6 +58,10 @@ pglz_decompress_hacked(const char *source, int32 slen, char *dest,
 				 * extremely!
 				 */
 				len = Min(len, destend - dp);
+				PGLZ_STATS_ADD(copies, 1);
+				PGLZ_STATS_ADD(overlapping_copies, off < len);
+				PGLZ_STATS_ADD(copy_bytes, len);
+				PGLZ_STATS_CLASS(copy_offset, off);
 				while (off < len)
 				{
 					memcpy(dp, dp - off, off);
@@ -96,7 +103,7 @@ pglz_decompress_hacked(const char *source, int32 slen, char *dest,
 	return (char*)dp - dest;
 }
 
-static unsigned char * pglz_decompress_emmit_match(unsigned char **sp, unsigned char *dp,
+static unsigned char * pglz_decompress_emmit_match(const unsigned char **sp, unsigned char *dp,
 						unsigned char *destend)
 {
 	/*
@@ -238,6 +245,85 @@ pglz_decompress_hacked_unrolled(const char *source, int32 slen, char *dest,
 }
 
 
+/* ----------
+ * pglz_decompress_hacked_runs -
+ *
+ *		Looks at the whole control byte first.  A group of 8 literals is
+ *		copied at once and a group of 8 tags is decoded without checking
+ *		the input for every tag.  Only groups that mix both are decoded
+ *		bit by bit.
+ * ----------
+ */
+int32
+pglz_decompress_hacked_runs(const char *source, int32 slen, char *dest,
+						 int32 rawsize, bool check_complete)
+{
+	const unsigned char *sp;
+	const unsigned char *srcend;
+	unsigned char *dp;
+	unsigned char *destend;
+
+	sp = (const unsigned char *) source;
+	srcend = ((const unsigned char *) source) + slen;
+	dp = (unsigned char *) dest;
+	destend = dp + rawsize;
+
+	while (sp < srcend && dp < destend)
+	{
+		unsigned char ctrl = *sp++;
+		int			ctrlc;
+
+		if (ctrl == 0 && srcend - sp >= 8 && destend - dp >= 8)
+		{
+			/*
+			 * Eight literal bytes follow.
+			 */
+			memcpy(dp, sp, 8);
+			dp += 8;
+			sp += 8;
+			continue;
+		}
+
+		if (ctrl == 0xff && srcend - sp >= 8 * 3)
+		{
+			/*
+			 * Eight tags of at most 3 bytes each follow.
+			 */
+			for (ctrlc = 0; ctrlc < 8 && dp < destend; ctrlc++)
+				dp = pglz_decompress_emmit_match(&sp, dp, destend);
+			continue;
+		}
+
+		for (ctrlc = 0; ctrlc < 8 && sp < srcend && dp < destend; ctrlc++)
+		{
+			if (ctrl & 1)
+				dp = pglz_decompress_emmit_match(&sp, dp, destend);
+			else
+				*dp++ = *sp++;
+
+			/*
+			 * Advance the control bit
+			 */
+			ctrl >>= 1;
+		}
+	}
+
+	/*
+	 * Check we decompressed the right amount.
+	 * If we are slicing, then we won't necessarily
+	 * be at the end of the source or dest buffers
+	 * when we hit a stop, so we don't test them.
+	 */
+	if (check_complete && (dp != destend || sp != srcend))
+		return -1;
+
+	/*
+	 * That's it.
+	 */
+	return (char*)dp - dest;
+}
+
+
 int32
 pglz_decompress_hacked4(const char *source, int32 slen, char *dest,
 						 int32 rawsize, bool check_complete)
@@ -651,3 +737,479 @@ pglz_decompress_hacked32(const char *source, int32 slen, char *dest,
 	 */
 	return (char*)dp - dest;
 }
+
+
+/*
+ * In the fast loop of pglz_decompress_fast() a control byte is only read
+ * while its 8 items surely are in the input: 1 control byte and at most
+ * 8 tags of 3 bytes.
+ */
+#define PGLZ_FAST_GROUP_INPUT	(1 + 8 * 3)
+
+/*
+ * Matches with offset less than 8 have their first 8 bytes copied one by
+ * one.  After that the pattern repeats at pglz_fast_offsets[off], which is
+ * at least 8, so the rest can be copied in 8 byte chunks.
+ */
+static const int32 pglz_fast_offsets[8] = {8, 8, 8, 9, 8, 10, 12, 14};
+
+/* ----------
+ * pglz_decompress_fast -
+ *
+ *		Decompresses source into dest like pglz_decompress_hacked(), but
+ *		dest must have PGLZ_DECOMPRESS_FAST_SLACK writable bytes after
+ *		rawsize.  While the input holds a whole control group and the
+ *		output has room for a longest match, items are decoded without
+ *		clamping and without input checks, literals of an all-literal
+ *		group are copied at once and matches are copied in 8 or 16 byte
+ *		chunks which may run past the end of the match.  The rest is
+ *		decoded by the careful loop.  Like pglz_decompress(), that loop
+ *		reads a tag cut off at the end of the input up to 2 bytes past
+ *		slen, and offsets are not checked against the start of dest, so
+ *		this is not meant for untrusted input.
+ * ----------
+ */
+int32
+pglz_decompress_fast(const char *source, int32 slen, char *dest,
+					 int32 rawsize, bool check_complete)
+{
+	const unsigned char *sp;
+	const unsigned char *srcend;
+	unsigned char *dp;
+	unsigned char *destend;
+	unsigned char ctrl = 0;
+	int			ctrlc = 8;
+
+	sp = (const unsigned char *) source;
+	srcend = ((const unsigned char *) source) + slen;
+	dp = (unsigned char *) dest;
+	destend = dp + rawsize;
+
+	while (srcend - sp >= PGLZ_FAST_GROUP_INPUT)
+	{
+		ctrl = *sp++;
+
+		/*
+		 * Eight literals in a row are copied at once.
+		 */
+		if (ctrl == 0 && destend - dp >= 8)
+		{
+			memcpy(dp, sp, 8);
+			dp += 8;
+			sp += 8;
+			continue;
+		}
+
+		for (ctrlc = 0; ctrlc < 8; ctrlc++)
+		{
+			/*
+			 * Leave the rest for the careful loop when a match might not
+			 * fit into the output anymore.
+			 */
+			if (destend - dp < PGLZ_MAX_MATCH)
+				goto careful;
+
+			if (ctrl & 1)
+			{
+				int32		len;
+				int32		off;
+				unsigned char *matchend;
+
+				len = (sp[0] & 0x0f) + 3;
+				off = ((sp[0] & 0xf0) << 4) | sp[1];
+				sp += 2;
+				if (len == 18)
+					len += *sp++;
+
+				/*
+				 * The match is copied in chunks, and pieces of the last
+				 * chunk beyond the match are overwritten by later items or
+				 * land in the slack.
+				 */
+				matchend = dp + len;
+				if (off >= 16)
+				{
+					do
+					{
+						memcpy(dp, dp - off, 16);
+						dp += 16;
+					} while (dp < matchend);
+				}
+				else
+				{
+					if (off < 8)
+					{
+						int			i;
+
+						for (i = 0; i < 8; i++)
+							dp[i] = dp[i - off];
+						dp += 8;
+						off = pglz_fast_offsets[off];
+					}
+					while (dp < matchend)
+					{
+						memcpy(dp, dp - off, 8);
+						dp += 8;
+					}
+				}
+				dp = matchend;
+			}
+			else
+			{
+				*dp++ = *sp++;
+			}
+
+			ctrl >>= 1;
+		}
+	}
+	ctrlc = 8;
+
+careful:
+
+	/*
+	 * Finish the current control group, if any, and decode the rest of the
+	 * input with all checks, as in pglz_decompress_hacked().
+	 */
+	for (;;)
+	{
+		for (; ctrlc < 8 && sp < srcend && dp < destend; ctrlc++)
+		{
+			if (ctrl & 1)
+			{
+				int32		len;
+				int32		off;
+
+				len = (sp[0] & 0x0f) + 3;
+				off = ((sp[0] & 0xf0) << 4) | sp[1];
+				sp += 2;
+				if (len == 18)
+					len += *sp++;
+
+				/*
+				 * A zero offset would make the copy below loop forever.
+				 */
+				if (off == 0)
+					return -1;
+
+				len = Min(len, destend - dp);
+				while (off < len)
+				{
+					memcpy(dp, dp - off, off);
+					len -= off;
+					dp += off;
+					off += off;
+				}
+				memcpy(dp, dp - off, len);
+				dp += len;
+			}
+			else
+			{
+				*dp++ = *sp++;
+			}
+
+			ctrl >>= 1;
+		}
+
+		if (sp >= srcend || dp >= destend)
+			break;
+
+		ctrl = *sp++;
+		ctrlc = 0;
+	}
+
+	/*
+	 * Check we decompressed the right amount.
+	 * If we are slicing, then we won't necessarily
+	 * be at the end of the source or dest buffers
+	 * when we hit a stop, so we don't test them.
+	 */
+	if (check_complete && (dp != destend || sp != srcend))
+		return -1;
+
+	/*
+	 * That's it.
+	 */
+	return (char *) dp - dest;
+}
+
+
+/* ----------
+ * pglz2_decompress -
+ *
+ *		Decompresses a pglz2 stream, see pglz2_compress_ctx() for the tags.
+ *		Arguments and result are those of pglz_decompress_hacked(); a
+ *		stream without the version byte is rejected.  Since the window is
+ *		16 times that of pglz, every tag is checked: it must be complete
+ *		within slen and its offset must stay within what was written, so
+ *		that corrupt input fails instead of reading outside the buffers.
+ * ----------
+ */
+int32
+pglz2_decompress(const char *source, int32 slen, char *dest,
+				 int32 rawsize, bool check_complete)
+{
+	const unsigned char *sp;
+	const unsigned char *srcend;
+	unsigned char *dp;
+	unsigned char *destend;
+
+	if (slen < 1 || (unsigned char) source[0] != PGLZ2_VERSION)
+		return -1;
+
+	sp = ((const unsigned char *) source) + 1;
+	srcend = ((const unsigned char *) source) + slen;
+	dp = (unsigned char *) dest;
+	destend = dp + rawsize;
+
+	while (sp < srcend && dp < destend)
+	{
+		/*
+		 * Read one control byte and process the next 8 items (or as many as
+		 * remain in the compressed input).
+		 */
+		unsigned char ctrl = *sp++;
+		int			ctrlc;
+
+		for (ctrlc = 0; ctrlc < 8 && sp < srcend && dp < destend; ctrlc++)
+		{
+			if (ctrl & 1)
+			{
+				int32		len;
+				int32		off;
+
+				if (unlikely(srcend - sp < 2))
+					return -1;
+				len = (sp[0] & 0x0f) + 3;
+				off = sp[0] >> 4;
+				if (off == 0x0f)
+				{
+					/* 16-bit offset in T2 and T3 */
+					if (unlikely(srcend - sp < 3))
+						return -1;
+					off = sp[1] | (sp[2] << 8);
+					sp += 3;
+				}
+				else
+				{
+					off = (off << 8) | sp[1];
+					sp += 2;
+				}
+				if (len == 18)
+				{
+					if (unlikely(sp >= srcend))
+						return -1;
+					len += *sp++;
+					if (len == 18 + 255)
+					{
+						if (unlikely(srcend - sp < 2))
+							return -1;
+						len += sp[0] | (sp[1] << 8);
+						sp += 2;
+					}
+				}
+
+				if (unlikely(off == 0 || off > dp - (unsigned char *) dest))
+					return -1;
+
+				/*
+				 * Copy in chunks of the offset, which doubles each time as
+				 * in pglz_decompress_hacked().
+				 */
+				len = Min(len, destend - dp);
+				while (off < len)
+				{
+					memcpy(dp, dp - off, off);
+					len -= off;
+					dp += off;
+					off += off;
+				}
+				memcpy(dp, dp - off, len);
+				dp += len;
+			}
+			else
+			{
+				/*
+				 * An unset control bit means LITERAL BYTE. So we just copy
+				 * one from INPUT to OUTPUT.
+				 */
+				*dp++ = *sp++;
+			}
+
+			/*
+			 * Advance the control bit
+			 */
+			ctrl >>= 1;
+		}
+	}
+
+	/*
+	 * Check we decompressed the right amount.
+	 */
+	if (check_complete && (dp != destend || sp != srcend))
+		return -1;
+
+	return (char *) dp - dest;
+}
+
+
+/* ----------
+ * pglz_stream_decompress_begin -
+ *
+ *		Starts a streaming decompression.
+ * ----------
+ */
+void
+pglz_stream_decompress_begin(PGLZ_StreamDecompressState *state)
+{
+	state->buf_len = 0;
+	state->buf_flushed = 0;
+	state->ctrl = 0;
+	state->ctrl_left = 0;
+	state->item_len = 0;
+}
+
+
+/* ----------
+ * pglz_stream_decompress_feed -
+ *
+ *		Decompresses the next piece of a stream made by pglz_stream_feed().
+ *		At most destsize bytes are written to dest, and the number of input
+ *		bytes used is stored in *consumed.  If that is less than slen, dest
+ *		was filled up and the rest of the input has to be fed again; call
+ *		with slen of 0 to get output still held in the state.  Returns the
+ *		number of bytes written, or -1 if the input is corrupt.
+ * ----------
+ */
+int32
+pglz_stream_decompress_feed(PGLZ_StreamDecompressState *state,
+							const char *source, int32 slen, int32 *consumed,
+							char *dest, int32 destsize)
+{
+	const unsigned char *sp = (const unsigned char *) source;
+	const unsigned char *srcend = sp + slen;
+	int32		produced = 0;
+
+	for (;;)
+	{
+		unsigned char *dp;
+		unsigned char *dplimit;
+		int32		n;
+
+		/*
+		 * Hand out what has been decoded so far.  Stop if it does not fit.
+		 */
+		n = Min(state->buf_len - state->buf_flushed, destsize - produced);
+		memcpy(dest + produced, state->buf + state->buf_flushed, n);
+		state->buf_flushed += n;
+		produced += n;
+		if (state->buf_flushed < state->buf_len || produced == destsize ||
+			sp >= srcend)
+			break;
+
+		/*
+		 * Keep the window the next tags may refer to, and make room for at
+		 * least one longest match after it.
+		 */
+		if (state->buf_len >= PGLZ_STREAM_BUFFER_SIZE - PGLZ_MAX_MATCH)
+		{
+			int32		shift = state->buf_len - PGLZ_MAX_OFFSET;
+
+			memmove(state->buf, state->buf + shift, PGLZ_MAX_OFFSET);
+			state->buf_len -= shift;
+			state->buf_flushed -= shift;
+		}
+
+		/*
+		 * Decode items while every one of them fits into the buffer, and no
+		 * more than the caller can take right away.
+		 */
+		dp = state->buf + state->buf_len;
+		dplimit = state->buf + Min(PGLZ_STREAM_BUFFER_SIZE - PGLZ_MAX_MATCH,
+								   state->buf_len + destsize - produced);
+		while (sp < srcend && dp < dplimit)
+		{
+			if (state->ctrl_left == 0)
+			{
+				state->ctrl = *sp++;
+				state->ctrl_left = 8;
+				continue;
+			}
+
+			if (state->ctrl & 1)
+			{
+				const unsigned char *tag;
+				int32		len;
+				int32		off;
+
+				/*
+				 * A tag may be split between this piece of input and the
+				 * previous one.  Collect it in the state if so.
+				 */
+				if (state->item_len == 0 && srcend - sp >= 3)
+					tag = sp;
+				else
+				{
+					while (sp < srcend && state->item_len < 2)
+						state->item[state->item_len++] = *sp++;
+					if (state->item_len == 2 && (state->item[0] & 0x0f) == 0x0f &&
+						sp < srcend)
+						state->item[state->item_len++] = *sp++;
+					if (state->item_len < 2 ||
+						(state->item_len == 2 && (state->item[0] & 0x0f) == 0x0f))
+						break;
+					tag = state->item;
+				}
+
+				len = (tag[0] & 0x0f) + 3;
+				off = ((tag[0] & 0xf0) << 4) | tag[1];
+				if (len == 18)
+					len += tag[2];
+				if (tag == sp)
+					sp += len >= 18 ? 3 : 2;
+				state->item_len = 0;
+
+				if (off == 0 || off > dp - state->buf)
+					return -1;
+
+				/*
+				 * Copy the match from OUTPUT to OUTPUT in growing
+				 * non-overlapping pieces.
+				 */
+				while (off < len)
+				{
+					memcpy(dp, dp - off, off);
+					len -= off;
+					dp += off;
+					off += off;
+				}
+				memcpy(dp, dp - off, len);
+				dp += len;
+			}
+			else
+			{
+				*dp++ = *sp++;
+			}
+
+			state->ctrl >>= 1;
+			state->ctrl_left--;
+		}
+		state->buf_len = dp - state->buf;
+	}
+
+	*consumed = (const char *) sp - source;
+	return produced;
+}
+
+
+/* ----------
+ * pglz_stream_decompress_finish -
+ *
+ *		Checks that the stream ended on an item boundary and all output
+ *		has been handed out.
+ * ----------
+ */
+bool
+pglz_stream_decompress_finish(PGLZ_StreamDecompressState *state)
+{
+	return state->item_len == 0 && state->buf_flushed == state->buf_len;
+}
@@ -0,0 +1,639 @@
+/* ----------
+ * pg_lzcompress_hacked.h -
+ *
+ *	Definitions for the hacked pglz compressor and decompressors.
+ *
+ * Copyright (c) 1999-2019, PostgreSQL Global Development Group
+ *
+ * contrib/test_pglz/pg_lzcompress_hacked.h
+ * ----------
+ */
+#ifndef _PG_LZCOMPRESS_HACKED_H_
+#define _PG_LZCOMPRESS_HACKED_H_
+
+#include "common/pg_lzcompress.h"
+
+
+/* ----------
+ * Limits of the format and sizes of the compressor history
+ * ----------
+ */
+#define PGLZ_MAX_MATCH			273
+#define PGLZ_MAX_OFFSET			0x0fff
+#define PGLZ_MAX_HISTORY_LISTS	8192	/* must be power of 2 */
+#define PGLZ_HISTORY_SIZE		(0x0fff - 1)	/* to avoid compare in iteration */
+
+/*
+ * Early rejection of incompressible input, see pglz_looks_incompressible()
+ * and pglz_probe_end()
+ */
+#define PGLZ_SAMPLE_SIZE		512
+#define PGLZ_SAMPLE_COLLISIONS	2048
+#define PGLZ_PROBE_SIZE			2048
+
+/*
+ * Bytes after the end of the output that pglz_decompress_fast() may
+ * overwrite.  Callers must allocate rawsize + PGLZ_DECOMPRESS_FAST_SLACK.
+ */
+#define PGLZ_DECOMPRESS_FAST_SLACK	16
+
+
+/* ----------
+ * PGLZ_CompressContext -
+ *
+ *		Work arrays for the history of one compression.
+ *
+ * Each thread that compresses concurrently must own a context.  A zeroed
+ * context is as good as one passed through pglz_compress_context_init().
+ *
+ * The history is a set of singly linked lists, one per hash key, kept as
+ * parallel arrays of 16-bit fields so that it stays cache resident.  Entry
+ * i remembers the next entry of its list in hist_next[i], its hash key in
+ * hist_key[i] and the low 16 bits of its input address in hist_pos[i].
+ * Entries only live for the last PGLZ_HISTORY_SIZE input positions, so
+ * the distance back to an entry, and from it the pointer, are recovered
+ * from the low bits alone.  Links are not changed during insertion in
+ * order to speed it up.  Instead more complicated stop condition is used
+ * during list iteration.  Element 0 is unused, and means 'invalid'.
+ *
+ * fast_table is the single-probe hash table of pglz_compress_fast_ctx();
+ * it holds input offsets of the last position seen for each hash key.
+ * ----------
+ */
+typedef struct PGLZ_CompressContext
+{
+	int16		hist_start[PGLZ_MAX_HISTORY_LISTS];
+	int16		hist_next[PGLZ_HISTORY_SIZE + 1];
+	uint16		hist_key[PGLZ_HISTORY_SIZE + 1];
+	uint16		hist_pos[PGLZ_HISTORY_SIZE + 1];
+	int32		fast_table[PGLZ_MAX_HISTORY_LISTS];
+} PGLZ_CompressContext;
+
+
+/* ----------
+ * PGLZ_Level -
+ *
+ *		Which compressor pglz_compress_level() uses.
+ * ----------
+ */
+typedef enum PGLZ_Level
+{
+	PGLZ_LEVEL_FAST,			/* pglz_compress_fast() */
+	PGLZ_LEVEL_DEFAULT,			/* pglz_compress_hacked() */
+	PGLZ_LEVEL_HIGH				/* pglz_compress_high() */
+} PGLZ_Level;
+
+#define PGLZ_LEVEL_COUNT		(PGLZ_LEVEL_HIGH + 1)
+
+
+/* ----------
+ * PGLZ_StrategyExt -
+ *
+ *		A strategy together with a compression level.  The strategy comes
+ *		first, so a pointer to it can be passed on to the compressors.
+ * ----------
+ */
+typedef struct PGLZ_StrategyExt
+{
+	PGLZ_Strategy strategy;
+	PGLZ_Level	level;
+} PGLZ_StrategyExt;
+
+
+/* ----------
+ * The provided leveled strategies, the default strategy with the fast and
+ * the high level
+ * ----------
+ */
+extern const PGLZ_StrategyExt *const PGLZ_strategy_fast;
+extern const PGLZ_StrategyExt *const PGLZ_strategy_high;
+
+
+/* ----------
+ * PGLZ_Slice -
+ *
+ *		One independent piece of work for the batch routines.
+ *
+ * For compression source/slen is the raw input and dest must be at least
+ * PGLZ_MAX_OUTPUT(slen) bytes.  For decompression source/slen is the
+ * compressed input and rawsize bytes are written to dest.  result gets
+ * the return value of the underlying routine.
+ * ----------
+ */
+typedef struct PGLZ_Slice
+{
+	const char *source;
+	int32		slen;
+	char	   *dest;
+	int32		rawsize;
+	int32		result;
+} PGLZ_Slice;
+
+/* Upper limit on threads used by the batch routines */
+#define PGLZ_BATCH_MAX_THREADS	64
+
+typedef int32 (*PGLZ_CompressFunc) (const char *source, int32 slen,
+									char *dest,
+									const PGLZ_Strategy *strategy);
+typedef int32 (*PGLZ_DecompressFunc) (const char *source, int32 slen,
+									  char *dest, int32 rawsize,
+									  bool check_complete);
+typedef int32 (*PGLZ_CompressCtxFunc) (PGLZ_CompressContext *ctx,
+									   const char *source, int32 slen,
+									   char *dest,
+									   const PGLZ_Strategy *strategy);
+
+
+/* ----------
+ * CPU features codecs may require, as returned by pglz_cpu_features()
+ * ----------
+ */
+#define PGLZ_CPU_SSSE3			0x01
+#define PGLZ_CPU_NEON			0x02
+
+/* Features of the vector match-copy kernel on this architecture, if any */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PGLZ_SIMD_FEATURES		PGLZ_CPU_SSSE3
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define PGLZ_SIMD_FEATURES		PGLZ_CPU_NEON
+#endif
+
+
+/* ----------
+ * PGLZ_Codec -
+ *
+ *		An entry of the codec registry.  Compressors have compress set,
+ *		decompressors decompress.  A codec may only be called if the CPU
+ *		has all of cpu_features, see pglz_codec_usable().  Decompressors
+ *		that are safe_for_untrusted never read or write outside their
+ *		buffers and always terminate, whatever the input; dest_slack is the
+ *		number of bytes past rawsize a decompressor may overwrite.
+ *		compress_ctx is the same compressor with a history of the caller's,
+ *		so that threads can compress concurrently; it is NULL for the
+ *		decompressors and for compressors with a static history only.  The
+ *		decompressors have no state and may always run concurrently.
+ * ----------
+ */
+typedef struct PGLZ_Codec
+{
+	const char *name;
+	PGLZ_CompressFunc compress;
+	PGLZ_DecompressFunc decompress;
+	uint32		cpu_features;
+	bool		safe_for_untrusted;
+	int32		dest_slack;
+	PGLZ_CompressCtxFunc compress_ctx;
+} PGLZ_Codec;
+
+extern const PGLZ_Codec pglz_compressors[];
+extern const int pglz_compressors_count;
+extern const PGLZ_Codec pglz_decompressors[];
+extern const int pglz_decompressors_count;
+
+/*
+ * Bytes after every output buffer the verification routines check for
+ * stray writes, and so the space pglz_verify_compress() needs for the
+ * compressed data.
+ */
+#define PGLZ_VERIFY_CANARY		64
+#define PGLZ_VERIFY_COMPRESS_SPACE(_slen) \
+	(PGLZ_MAX_OUTPUT(_slen) + PGLZ_VERIFY_CANARY)
+
+
+/* ----------
+ * PGLZ_Adversary -
+ *
+ *		A generator of a synthetic worst-case payload, filling size bytes
+ *		at dest.  See pg_lzcompress_adversary.c for the list.
+ * ----------
+ */
+typedef struct PGLZ_Adversary
+{
+	const char *name;
+	void		(*generate) (unsigned char *dest, int64 size);
+} PGLZ_Adversary;
+
+/* Size of the generated payloads, like that of the payload files */
+#define PGLZ_ADVERSARY_SIZE		(1024 * 1024)
+
+extern const PGLZ_Adversary pglz_adversaries[];
+extern const int pglz_adversaries_count;
+
+
+/* ----------
+ * PGLZ_Dictionary -
+ *
+ *		Data that primes the history of dictionary compression, see
+ *		pg_lzcompress_dict.c.  Matches can reach as far back as the
+ *		history, which bounds its size.
+ * ----------
+ */
+#define PGLZ_DICT_MAX_SIZE		PGLZ_HISTORY_SIZE
+
+typedef struct PGLZ_Dictionary
+{
+	int32		size;
+	char		data[PGLZ_DICT_MAX_SIZE];
+} PGLZ_Dictionary;
+
+
+/* ----------
+ * PGLZ_Segment -
+ *
+ *		One of the caller buffers pglz_decompress_scatter() writes the
+ *		output to, see pg_lzcompress_scatter.c.
+ * ----------
+ */
+typedef struct PGLZ_Segment
+{
+	char	   *data;
+	int32		len;
+} PGLZ_Segment;
+
+
+/* ----------
+ * Block-indexed containers, see pg_lzcompress_blocks.c
+ * ----------
+ */
+#define PGLZ_BLOCKS_DEFAULT_SIZE	65536
+
+/* Number of blocks of a value, without overflowing for large ones */
+#define PGLZ_BLOCKS_COUNT(_rawsize, _block_size) \
+	((_rawsize) / (_block_size) + ((_rawsize) % (_block_size) != 0))
+
+/* Size of the header and the index of a container of _nblocks blocks */
+#define PGLZ_BLOCKS_INDEX_SIZE(_nblocks) \
+	((int32) sizeof(int32) * (2 + (_nblocks)))
+
+/* Output space pglz_compress_blocks() needs */
+#define PGLZ_BLOCKS_MAX_OUTPUT(_slen, _block_size) \
+	(PGLZ_BLOCKS_INDEX_SIZE(PGLZ_BLOCKS_COUNT(_slen, _block_size)) + \
+	 PGLZ_MAX_OUTPUT(_slen))
+
+
+/* ----------
+ * The pglz2 variant of the format, see pglz2_compress_ctx().  A pglz2
+ * stream starts with a version byte and has wider tags, so that matches
+ * reach back PGLZ2_MAX_OFFSET bytes and copy up to PGLZ2_MAX_MATCH.
+ * ----------
+ */
+#define PGLZ2_VERSION			2
+#define PGLZ2_MAX_MATCH			(18 + 255 + 0xffff)
+#define PGLZ2_MAX_OFFSET		0xffff
+#define PGLZ2_MAX_CHAIN			64	/* history entries looked at per match */
+#define PGLZ2_HASH_SIZE			65536	/* must be power of 2 */
+#define PGLZ2_WINDOW_SIZE		65536	/* power of 2 above PGLZ2_MAX_OFFSET */
+
+/* The version byte, a control byte and a 6-byte tag of slop */
+#define PGLZ2_MAX_OUTPUT(_dlen)	((_dlen) + 8)
+
+/* ----------
+ * PGLZ2_CompressContext -
+ *
+ *		Work arrays of one pglz2 compression.  head holds the input offset
+ *		of the last position with each hash key, or -1, and prev[i] the
+ *		offset before i with the same key as i, for the last
+ *		PGLZ2_WINDOW_SIZE offsets i.  Neither needs any initialization.
+ *		It is big; allocate it rather than keeping it on the stack.
+ * ----------
+ */
+typedef struct PGLZ2_CompressContext
+{
+	int32		head[PGLZ2_HASH_SIZE];
+	int32		prev[PGLZ2_WINDOW_SIZE];
+} PGLZ2_CompressContext;
+
+
+/* ----------
+ * Streaming compression
+ *
+ * The streaming routines keep PGLZ_STREAM_BUFFER_SIZE bytes of data in their
+ * state: the window of the last PGLZ_MAX_OFFSET bytes and what was fed
+ * after it.  The concatenated output of pglz_stream_feed() and
+ * pglz_stream_finish() is a single pglz stream of all input fed.
+ * ----------
+ */
+#define PGLZ_STREAM_BUFFER_SIZE		65536
+
+/* Input the encoder holds back so that matches can run to full length */
+#define PGLZ_STREAM_LOOKAHEAD		(PGLZ_MAX_MATCH + 4)
+
+/* A control byte and 8 tags of 3 bytes */
+#define PGLZ_STREAM_GROUP_SIZE		25
+
+/*
+ * Output space pglz_stream_feed() needs for _slen bytes of input.  Pass 0
+ * for pglz_stream_finish().
+ */
+#define PGLZ_STREAM_MAX_OUTPUT(_slen) \
+	((_slen) + PGLZ_STREAM_LOOKAHEAD + \
+	 ((_slen) + PGLZ_STREAM_LOOKAHEAD) / 8 + 1 + PGLZ_STREAM_GROUP_SIZE)
+
+/* ----------
+ * PGLZ_StreamState -
+ *
+ *		State of a streaming compression.  It is big; allocate it rather
+ *		than keeping it on the stack.
+ * ----------
+ */
+typedef struct PGLZ_StreamState
+{
+	PGLZ_CompressContext ctx;
+	unsigned char buf[PGLZ_STREAM_BUFFER_SIZE];
+	int32		buf_len;		/* bytes in buf */
+	int32		buf_pos;		/* first byte of buf not compressed yet */
+	uint16		hist_next;
+	uint16		hist_idx;
+	bool		hist_started;	/* hist_idx has been computed */
+	int32		good_match;
+	int32		good_drop;
+	unsigned char group[PGLZ_STREAM_GROUP_SIZE];	/* open control group */
+	int32		group_len;
+	unsigned char control_pos;
+	int64		raw_size;		/* total bytes fed */
+} PGLZ_StreamState;
+
+/* ----------
+ * PGLZ_StreamDecompressState -
+ *
+ *		State of a streaming decompression.  buf holds the window of output
+ *		that later tags may refer to, followed by output not handed to the
+ *		caller yet.  A tag split over two calls is kept in item.
+ * ----------
+ */
+typedef struct PGLZ_StreamDecompressState
+{
+	unsigned char buf[PGLZ_STREAM_BUFFER_SIZE];
+	int32		buf_len;		/* bytes in buf */
+	int32		buf_flushed;	/* bytes of buf handed to the caller */
+	unsigned char ctrl;			/* remaining bits of the control byte */
+	int32		ctrl_left;		/* items left in the control group */
+	unsigned char item[3];		/* incomplete tag */
+	int32		item_len;
+} PGLZ_StreamDecompressState;
+
+
+/* ----------
+ * PGLZ_Stats -
+ *
+ *		Counters of what pglz_compress_hacked() and pglz_decompress_hacked()
+ *		do, kept only if the module is built with -DPGLZ_STATS; otherwise
+ *		the PGLZ_STATS_* macros compile to nothing.  The history lookups are
+ *		counted in pglz_find_match(), which the high and the streaming
+ *		compressors share.  Each thread counts in its own pglz_stats, so
+ *		that the helpers of the batch routines do not race with each other
+ *		or the caller; they add their counts to a shared total with
+ *		pglz_stats_flush() after every batch, and pglz_stats_collect()
+ *		returns the total together with the counts of the calling thread.
+ *
+ *		The histograms are indexed by pglz_stats_class(): class 0 counts
+ *		the value 0, class k > 0 the values from 2^(k-1) to 2^k - 1.
+ *		Keep every field int64; pglz_stats_flush() depends on it.
+ * ----------
+ */
+#define PGLZ_STATS_CLASSES		13	/* enough for PGLZ_MAX_OFFSET */
+
+typedef struct PGLZ_Stats
+{
+	/* compression */
+	int64		compress_calls;
+	int64		literals;
+	int64		matches;
+	int64		match_bytes;
+	int64		lookups;		/* calls of pglz_find_match() */
+	int64		chain_steps;	/* history entries compared */
+	int64		good_match_stops;	/* lookups ended by a good match */
+	int64		good_match_decay_stops; /* ... after good_match was lowered */
+	int64		chain_length[PGLZ_STATS_CLASSES];	/* entries per lookup */
+	int64		match_length[PGLZ_STATS_CLASSES];
+	int64		match_offset[PGLZ_STATS_CLASSES];
+
+	/* decompression */
+	int64		decompress_calls;
+	int64		copies;
+	int64		overlapping_copies; /* offset below the length */
+	int64		copy_bytes;
+	int64		copy_offset[PGLZ_STATS_CLASSES];
+} PGLZ_Stats;
+
+static inline int
+pglz_stats_class(uint32 value)
+{
+	int			cls = 0;
+
+	while (value != 0 && cls < PGLZ_STATS_CLASSES - 1)
+	{
+		value >>= 1;
+		cls++;
+	}
+	return cls;
+}
+
+#ifdef PGLZ_STATS
+extern __thread PGLZ_Stats pglz_stats;
+extern void pglz_stats_reset(void);
+extern void pglz_stats_flush(void);
+extern void pglz_stats_collect(PGLZ_Stats *stats);
+
+#define PGLZ_STATS_ADD(_field, _n)		(pglz_stats._field += (_n))
+#define PGLZ_STATS_CLASS(_hist, _value) \
+	(pglz_stats._hist[pglz_stats_class(_value)]++)
+#else
+#define PGLZ_STATS_ADD(_field, _n)		((void) 0)
+#define PGLZ_STATS_CLASS(_hist, _value)	((void) 0)
+#endif
+
+
+/* ----------
+ * PGLZ_PerfCounters -
+ *
+ *		Hardware counters of the calling thread, read with perf_event_open()
+ *		on Linux.  They only count between pglz_perf_start() and
+ *		pglz_perf_stop(), in user space, and add up over all such periods.
+ *		An event the CPU or the kernel does not offer has fd -1 and is
+ *		read as -1.
+ * ----------
+ */
+typedef enum PGLZ_PerfEvent
+{
+	PGLZ_PERF_CYCLES,
+	PGLZ_PERF_INSTRUCTIONS,
+	PGLZ_PERF_BRANCH_MISSES,
+	PGLZ_PERF_L1D_MISSES,
+	PGLZ_PERF_LLC_MISSES,
+	PGLZ_PERF_EVENTS			/* number of events */
+} PGLZ_PerfEvent;
+
+typedef struct PGLZ_PerfCounters
+{
+	int			fd[PGLZ_PERF_EVENTS];	/* fd[PGLZ_PERF_CYCLES] leads */
+} PGLZ_PerfCounters;
+
+
+/* ----------
+ * Global function declarations
+ * ----------
+ */
+extern void pglz_compress_context_init(PGLZ_CompressContext *ctx);
+extern void pglz_compress_context_reset(PGLZ_CompressContext *ctx);
+extern int32 pglz_compress_hacked_ctx(PGLZ_CompressContext *ctx,
+									  const char *source, int32 slen,
+									  char *dest,
+									  const PGLZ_Strategy *strategy);
+extern int32 pglz_compress_hacked(const char *source, int32 slen, char *dest,
+								  const PGLZ_Strategy *strategy);
+extern int32 pglz_compress_fast_ctx(PGLZ_CompressContext *ctx,
+									const char *source, int32 slen,
+									char *dest,
+									const PGLZ_Strategy *strategy);
+extern int32 pglz_compress_fast(const char *source, int32 slen, char *dest,
+								const PGLZ_Strategy *strategy);
+extern int32 pglz_compress_high_ctx(PGLZ_CompressContext *ctx,
+									const char *source, int32 slen,
+									char *dest,
+									const PGLZ_Strategy *strategy);
+extern int32 pglz_compress_high(const char *source, int32 slen, char *dest,
+								const PGLZ_Strategy *strategy);
+extern int32 pglz_compress_bounded_ctx(PGLZ_CompressContext *ctx,
+									   const char *source, int32 slen,
+									   char *dest, int32 dest_size,
+									   const PGLZ_Strategy *strategy);
+extern int32 pglz_compress_bounded(const char *source, int32 slen, char *dest,
+								   int32 dest_size,
+								   const PGLZ_Strategy *strategy);
+extern int32 pglz_compress_primed_ctx(PGLZ_CompressContext *ctx,
+									  const char *source, int32 slen,
+									  char *dest,
+									  const PGLZ_Strategy *strategy,
+									  int32 prefix_len);
+extern int32 pglz_compress_level_ctx(PGLZ_CompressContext *ctx,
+									 const char *source, int32 slen,
+									 char *dest,
+									 const PGLZ_StrategyExt *strategy);
+extern int32 pglz_compress_level(const char *source, int32 slen, char *dest,
+								 const PGLZ_StrategyExt *strategy);
+
+extern int32 pglz2_compress_ctx(PGLZ2_CompressContext *ctx,
+								const char *source, int32 slen, char *dest,
+								const PGLZ_Strategy *strategy);
+extern int32 pglz2_compress(const char *source, int32 slen, char *dest,
+							const PGLZ_Strategy *strategy);
+
+extern void pglz_stream_begin(PGLZ_StreamState *state,
+							  const PGLZ_Strategy *strategy);
+extern int32 pglz_stream_feed(PGLZ_StreamState *state, const char *source,
+							  int32 slen, char *dest);
+extern int32 pglz_stream_finish(PGLZ_StreamState *state, char *dest);
+
+extern uint32 pglz_cpu_features(void);
+extern bool pglz_codec_usable(const PGLZ_Codec *codec);
+extern const PGLZ_Codec *pglz_find_codec(const PGLZ_Codec *codecs, int count,
+										 const char *name);
+extern const char *pglz_verify_compress(const PGLZ_Codec *compressor,
+										const char *source, int32 slen,
+										char *dest, int32 *clen);
+extern const char *pglz_verify_decompress(const PGLZ_Codec *decompressor,
+										  const char *compressed, int32 clen,
+										  const char *source, int32 slen);
+extern const char *pglz_verify_stream(const PGLZ_Codec *decompressor,
+									  const char *stream, int32 slen,
+									  int32 rawsize, bool check_complete);
+
+extern int32 pglz_compress_vanilla(const char *source, int32 slen, char *dest,
+								   const PGLZ_Strategy *strategy);
+extern int32 pglz_decompress_vanilla(const char *source, int32 slen,
+									 char *dest, int32 rawsize,
+									 bool check_complete);
+
+extern int32 pglz_decompress_hacked(const char *source, int32 slen,
+									char *dest, int32 rawsize,
+									bool check_complete);
+extern int32 pglz_decompress_hacked_unrolled(const char *source, int32 slen,
+											 char *dest, int32 rawsize,
+											 bool check_complete);
+extern int32 pglz_decompress_hacked4(const char *source, int32 slen,
+									 char *dest, int32 rawsize,
+									 bool check_complete);
+extern int32 pglz_decompress_hacked8(const char *source, int32 slen,
+									 char *dest, int32 rawsize,
+									 bool check_complete);
+extern int32 pglz_decompress_hacked16(const char *source, int32 slen,
+									  char *dest, int32 rawsize,
+									  bool check_complete);
+extern int32 pglz_decompress_hacked32(const char *source, int32 slen,
+									  char *dest, int32 rawsize,
+									  bool check_complete);
+extern int32 pglz_decompress_hacked_runs(const char *source, int32 slen,
+										 char *dest, int32 rawsize,
+										 bool check_complete);
+extern int32 pglz_decompress_fast(const char *source, int32 slen, char *dest,
+								  int32 rawsize, bool check_complete);
+extern int32 pglz_decompress_hacked_simd(const char *source, int32 slen,
+										 char *dest, int32 rawsize,
+										 bool check_complete);
+#ifdef PGLZ_SIMD_FEATURES
+extern int32 pglz_decompress_hacked_shuffle(const char *source, int32 slen,
+											char *dest, int32 rawsize,
+											bool check_complete);
+#endif
+extern int32 pglz2_decompress(const char *source, int32 slen, char *dest,
+							  int32 rawsize, bool check_complete);
+extern void pglz_decompress_auto_init(void);
+extern int32 pglz_decompress_auto(const char *source, int32 slen, char *dest,
+								  int32 rawsize, bool check_complete);
+extern const char *pglz_decompress_auto_name(void);
+extern void pglz_stream_decompress_begin(PGLZ_StreamDecompressState *state);
+extern int32 pglz_stream_decompress_feed(PGLZ_StreamDecompressState *state,
+										 const char *source, int32 slen,
+										 int32 *consumed, char *dest,
+										 int32 destsize);
+extern bool pglz_stream_decompress_finish(PGLZ_StreamDecompressState *state);
+
+extern void pglz_dict_load(PGLZ_Dictionary *dict, const char *data,
+						   int32 size);
+extern int32 pglz_dict_train(PGLZ_Dictionary *dict, const char *samples,
+							 const int32 *sample_sizes, int nsamples,
+							 int32 dict_size);
+extern int32 pglz_compress_dict_ctx(PGLZ_CompressContext *ctx,
+									const PGLZ_Dictionary *dict,
+									const char *source, int32 slen,
+									char *dest,
+									const PGLZ_Strategy *strategy);
+extern int32 pglz_compress_dict(const PGLZ_Dictionary *dict,
+								const char *source, int32 slen, char *dest,
+								const PGLZ_Strategy *strategy);
+extern int32 pglz_decompress_dict(const PGLZ_Dictionary *dict,
+								  const char *source, int32 slen,
+								  char *dest, int32 rawsize,
+								  bool check_complete);
+
+extern int32 pglz_decompress_scatter(const char *source, int32 slen,
+									 const PGLZ_Segment *segments,
+									 int nsegments, bool check_complete);
+
+extern int32 pglz_compress_blocks(const char *source, int32 slen, char *dest,
+								  int32 block_size,
+								  const PGLZ_Strategy *strategy);
+extern int32 pglz_blocks_rawsize(const char *source, int32 slen);
+extern int32 pglz_decompress_range(const char *source, int32 slen, char *dest,
+								   int32 raw_off, int32 raw_len,
+								   PGLZ_DecompressFunc decompress);
+
+extern bool pglz_perf_open(PGLZ_PerfCounters *counters);
+extern void pglz_perf_start(PGLZ_PerfCounters *counters);
+extern void pglz_perf_stop(PGLZ_PerfCounters *counters);
+extern void pglz_perf_read(PGLZ_PerfCounters *counters,
+						   int64 values[PGLZ_PERF_EVENTS]);
+extern void pglz_perf_close(PGLZ_PerfCounters *counters);
+
+extern void pglz_compress_batch(PGLZ_Slice *slices, int nslices,
+								const PGLZ_Strategy *strategy, int nthreads);
+extern void pglz_decompress_batch(PGLZ_Slice *slices, int nslices,
+								  PGLZ_DecompressFunc decompress,
+								  bool check_complete, int nthreads);
+extern int	pglz_decompress_pipelined(PGLZ_Slice *slices, int nslices,
+									  PGLZ_DecompressFunc decompress,
+									  bool check_complete, int distance,
+									  bool background);
+
+#endif							/* _PG_LZCOMPRESS_HACKED_H_ */
@@ -28,6 +28,44 @@
  *				case the contents of dest are undefined.
  *
  *			int32
+ *			pglz_compress_hacked_ctx(PGLZ_CompressContext *ctx,
+ *						  const char *source, int32 slen, char *dest,
+ *						  const PGLZ_Strategy *strategy);
+ *
+ *				Same as above, but the history tables live in ctx, which
+ *				must have been set up by pglz_compress_context_init().
+ *				Compressions with different contexts may run concurrently.
+ *
+ *			int32
+ *			pglz_compress_primed_ctx(PGLZ_CompressContext *ctx,
+ *						  const char *source, int32 slen, char *dest,
+ *						  const PGLZ_Strategy *strategy, int32 prefix_len);
+ *
+ *				Same again, but matches may also refer to the prefix_len
+ *				bytes in memory before source, such as a dictionary.
+ *
+ *			int32
+ *			pglz_compress_bounded_ctx(PGLZ_CompressContext *ctx,
+ *						  const char *source, int32 slen, char *dest,
+ *						  int32 dest_size, const PGLZ_Strategy *strategy);
+ *
+ *				Same as pglz_compress_hacked_ctx(), but dest only has to
+ *				hold dest_size bytes, not PGLZ_MAX_OUTPUT(slen), so that
+ *				the result can go straight to its final place.  Fails if
+ *				the result would take more than dest_size - 4 bytes.
+ *				pglz_compress_bounded() uses the shared context.
+ *
+ *			int32
+ *			pglz2_compress_ctx(PGLZ2_CompressContext *ctx,
+ *						  const char *source, int32 slen, char *dest,
+ *						  const PGLZ_Strategy *strategy);
+ *
+ *				Compresses into the pglz2 variant of the format, whose
+ *				tags reach back 64kB and copy up to 64kB.  dest must be
+ *				PGLZ2_MAX_OUTPUT(slen) bytes.  The result can only be
+ *				read by pglz2_decompress().
+ *
+ *			int32
  *			pglz_decompress(const char *source, int32 slen, char *dest,
  *							int32 rawsize, bool check_complete)
  *
@@ -189,6 +227,7 @@
 #include <limits.h>
 
 #include "common/pg_lzcompress.h"
+#include "pg_lzcompress_hacked.h"
 
 
 /**************************************
@@ -236,78 +275,47 @@ static uint32 pglz_read32(const void* ptr)
 #endif /* PGLZ_FORCE_MEMORY_ACCESS */
 
 
-/* ----------
- * Local definitions
- * ----------
- */
-#define PGLZ_MAX_HISTORY_LISTS	8192	/* must be power of 2 */
-#define PGLZ_HISTORY_SIZE	    0x0fff - 1    /* to avoid compare in iteration */
-#define PGLZ_MAX_MATCH			273
-
-
-/* ----------
- * PGLZ_HistEntry -
- *
- *		Linked list for the backward history lookup
- *
- * All the entries sharing a hash key are linked in a singly linked list.
- * Links are not changed during insertion in order to speed it up.
- * Instead more complicated stop condition is used during list iteration. 
- * ----------
+/*
+ * PGLZ_strategy_default and PGLZ_strategy_always are defined in
+ * pg_lzcompress_vanilla.c.
  */
-typedef struct PGLZ_HistEntry
-{
-    int16 next_id;                      /* links for my hash key's list */
-    uint16 hist_idx;                    /* my current hash key */
-	const unsigned char *pos;			/* my input position */
-} PGLZ_HistEntry;
 
 
 /* ----------
- * The provided standard strategies
+ * Strategies that pick a compressor
  * ----------
  */
-static const PGLZ_Strategy strategy_default_data = {
-	32,							/* Data chunks less than 32 bytes are not
-								 * compressed */
-	INT_MAX,					/* No upper limit on what we'll try to
-								 * compress */
-	25,							/* Require 25% compression rate, or not worth
-								 * it */
-	1024,						/* Give up if no compression in the first 1KB */
-	128,						/* Stop history lookup if a match of 128 bytes
-								 * is found */
-	10							/* Lower good match size by 10% at every loop
-								 * iteration */
+static const PGLZ_StrategyExt strategy_fast_data = {
+	{32, INT_MAX, 25, 1024, 128, 10},	/* Same as the default strategy */
+	PGLZ_LEVEL_FAST
 };
-//const PGLZ_Strategy *const PGLZ_strategy_default = &strategy_default_data;
+const PGLZ_StrategyExt *const PGLZ_strategy_fast = &strategy_fast_data;
 
 
-static const PGLZ_Strategy strategy_always_data = {
-	0,							/* Chunks of any size are compressed */
-	INT_MAX,
-	0,							/* It's enough to save one single byte */
-	INT_MAX,					/* Never give up early */
-	128,						/* Stop history lookup if a match of 128 bytes
-								 * is found */
-	6							/* Look harder for a good match */
+static const PGLZ_StrategyExt strategy_high_data = {
+	{32, INT_MAX, 25, 1024, 128, 10},	/* Same as the default strategy */
+	PGLZ_LEVEL_HIGH
 };
-//const PGLZ_Strategy *const PGLZ_strategy_always = &strategy_always_data;
+const PGLZ_StrategyExt *const PGLZ_strategy_high = &strategy_high_data;
 
 
 /* ----------
- * Statically allocated work arrays for history
+ * Context used by pglz_compress_hacked()
  * ----------
  */
-static int16 hist_start[PGLZ_MAX_HISTORY_LISTS];
-static PGLZ_HistEntry hist_entries[PGLZ_HISTORY_SIZE + 1];
+static PGLZ_CompressContext default_context;
 
 /*
- * Element 0 in hist_entries is unused, and means 'invalid'. Likewise,
- * INVALID_ENTRY_PTR in next/prev pointers mean 'invalid'.
+ * Element 0 in the history is unused, and means 'invalid'.
  */
 #define INVALID_ENTRY			0
-#define INVALID_ENTRY_PTR		(&hist_entries[INVALID_ENTRY])
+
+/*
+ * Low 16 bits of an input address, as kept in hist_pos.  The history never
+ * reaches further back than PGLZ_HISTORY_SIZE bytes, so the difference of
+ * two of them is the exact distance.
+ */
+#define PGLZ_POS16(p)			((uint16) (uintptr_t) (p))
 
 /* ----------
  * pglz_hist_idx -
@@ -335,17 +343,17 @@ static inline uint16 pglz_hist_idx(const unsigned char* s, uint16 mask)
  * ----------
  */
 static inline int16
-pglz_hist_add(int16 hist_next, uint16 *hist_idx, const unsigned char* s, uint16 mask)
+pglz_hist_add(PGLZ_CompressContext *ctx, int16 hist_next, uint16 *hist_idx,
+			  const unsigned char* s, uint16 mask)
 {
-    int16* my_hist_start = &hist_start[*hist_idx];
-    PGLZ_HistEntry* entry = &(hist_entries)[hist_next];
+    int16* my_hist_start = &ctx->hist_start[*hist_idx];
 
     /*
      * Initialize entry with a new value.
      */ 
-    entry->next_id = *my_hist_start;
-    entry->hist_idx = *hist_idx;
-    entry->pos = s;
+    ctx->hist_next[hist_next] = *my_hist_start;
+    ctx->hist_key[hist_next] = *hist_idx;
+    ctx->hist_pos[hist_next] = PGLZ_POS16(s);
 
     /*
      * Update linked list head pointer.
@@ -429,40 +437,54 @@ pglz_compare(int32 len, int32 len_bound, const unsigned char* input_pos,
  * ----------
  */
 static inline int
-pglz_find_match(uint16 hist_idx, const unsigned char *input, const unsigned char *end,
+pglz_find_match(PGLZ_CompressContext *ctx, uint16 hist_idx, const unsigned char *input, const unsigned char *end,
 				int *len_ptr, int *offset_ptr, int good_match, int good_drop)
 {
-	PGLZ_HistEntry *hist_entry;
 	int16		*hist_entry_number;
+	int16		hist_entry;
+	uint16		input_pos16 = PGLZ_POS16(input);
+	uint16		hist_dist;
 	int32		len = 0;
 	int32		offset = 0;
 	int32		cur_len = 0;
     int32       len_bound = Min(end - input, PGLZ_MAX_MATCH);
+#ifdef PGLZ_STATS
+	int32		steps = 0;
+#endif
+
+	PGLZ_STATS_ADD(lookups, 1);
 
 	/*
 	 * Traverse the linked history list until a good enough match is found.
 	 */
-	hist_entry_number = &hist_start[hist_idx];
+	hist_entry_number = &ctx->hist_start[hist_idx];
     if (*hist_entry_number == INVALID_ENTRY)
+    {
+        PGLZ_STATS_CLASS(chain_length, 0);
         return 0;
+    }
 
-    hist_entry = &hist_entries[*hist_entry_number];
-    if (hist_idx != hist_entry->hist_idx)
+    hist_entry = *hist_entry_number;
+    if (hist_idx != ctx->hist_key[hist_entry])
     {
         /*
          * If current linked list head points to invalid entry
          * then clear it to reduce a number of comparisons in future.
          */
         *hist_entry_number = INVALID_ENTRY;
+        PGLZ_STATS_CLASS(chain_length, 0);
         return 0;
     }
 
     while(true)
 	{
 		const unsigned char *input_pos = input;
-		const unsigned char *hist_pos = hist_entry->pos;
-        const unsigned char *my_pos;
-		int32		cur_offset = input_pos - hist_pos;
+		int32		cur_offset = (uint16) (input_pos16 - ctx->hist_pos[hist_entry]);
+		const unsigned char *hist_pos = input_pos - cur_offset;
+
+#ifdef PGLZ_STATS
+		steps++;
+#endif
 
 		/*
 		 * Determine length of match. A better match must be larger than the
@@ -496,8 +518,8 @@ pglz_find_match(uint16 hist_idx, const unsigned char *input, const unsigned char
 		/*
 		 * Advance to the next history entry
 		 */
-        my_pos = hist_entry->pos;
-        hist_entry = &hist_entries[hist_entry->next_id];
+        hist_entry = ctx->hist_next[hist_entry];
+        hist_dist = input_pos16 - ctx->hist_pos[hist_entry];
 
         /*
          * If current match length is ok then stop iteration.
@@ -505,10 +527,19 @@ pglz_find_match(uint16 hist_idx, const unsigned char *input, const unsigned char
          * then additional stop condition should be introduced to avoid following them.
          * If recycled entry has another hash, then iteration stops.
          * If it has the same hash then recycled cell would break input stream
-         * position monotonicity what is checked after.
+         * position monotonicity what is checked after: the next entry must be
+         * further back than this one.
          */
-        if (len >= good_match || hist_idx != hist_entry->hist_idx || my_pos <= hist_entry->pos)
+        if (len >= good_match || hist_idx != ctx->hist_key[hist_entry] || hist_dist <= cur_offset)
         {
+#ifdef PGLZ_STATS
+            if (len >= good_match)
+            {
+                pglz_stats.good_match_stops++;
+                if (steps > 1)
+                    pglz_stats.good_match_decay_stops++;
+            }
+#endif
             break;
         }
 		/*
@@ -517,6 +548,9 @@ pglz_find_match(uint16 hist_idx, const unsigned char *input, const unsigned char
         good_match -= (good_match * good_drop) >> 7;
 	}
 
+    PGLZ_STATS_ADD(chain_steps, steps);
+    PGLZ_STATS_CLASS(chain_length, steps);
+
     /*
      * As initial compare for short matches compares 4 bytes
      * then for the end of stream length of match should be cut
@@ -539,59 +573,18 @@ pglz_find_match(uint16 hist_idx, const unsigned char *input, const unsigned char
 
 
 /* ----------
- * pglz_compress -
+ * pglz_match_limits -
  *
- *		Compresses source into dest using strategy. Returns the number of
- *		bytes written in buffer dest, or -1 if compression fails.
+ *		Limits the match parameters of strategy to the supported range.
  * ----------
  */
-int32
-pglz_compress_hacked(const char *source, int32 src_len, char *dest,
-			  const PGLZ_Strategy *strategy)
+static inline void
+pglz_match_limits(const PGLZ_Strategy *strategy, int32 *good_match_ptr,
+				  int32 *good_drop_ptr)
 {
-	unsigned char *dest_ptr = (unsigned char *) dest;
-	unsigned char *dest_start = dest_ptr;
-	uint16			hist_next = 1;
-    uint16          hist_idx;
-	const unsigned char *src_ptr = (const unsigned char*)source;
-	const unsigned char *src_end = (const unsigned char*)source + src_len;
-    const unsigned char *compress_src_end = src_end - 4;
-	unsigned char control_dummy = 0;
-	unsigned char *control_ptr = &control_dummy;
-	unsigned char control_byte = 0;
-	unsigned char control_pos = 0;
-	bool		found_match = false;
-	int32		match_len;
-	int32		match_offset;
 	int32		good_match;
 	int32		good_drop;
-	int32		result_size;
-	int32		result_max;
-	int32		need_rate;
-	int			hash_size;
-	uint16		mask;
-
-
-	/*
-	 * Our fallback strategy is the default.
-	 */
-	if (strategy == NULL)
-    {
-		strategy = PGLZ_strategy_default;
-    }
-
-	/*
-	 * If the strategy forbids compression (at all or if source chunk size out
-	 * of range), fail.
-	 */
-	if (strategy->match_size_good <= 0 ||
-		src_len < strategy->min_input_size ||
-		src_len > strategy->max_input_size)
-		return -1;
 
-	/*
-	 * Limit the match parameters to the supported range.
-	 */
 	good_match = strategy->match_size_good;
 	if (good_match > PGLZ_MAX_MATCH)
 		good_match = PGLZ_MAX_MATCH;
@@ -605,6 +598,37 @@ pglz_compress_hacked(const char *source, int32 src_len, char *dest,
 		good_drop = 100;
     good_drop = good_drop * 128 / 100;
 
+	*good_match_ptr = good_match;
+	*good_drop_ptr = good_drop;
+}
+
+
+/* ----------
+ * pglz_prepare_strategy -
+ *
+ *		Checks whether strategy allows to compress src_len bytes and limits
+ *		its parameters to the supported range.  On success the lookup limits
+ *		and the maximum result size are stored and true is returned.
+ * ----------
+ */
+static inline bool
+pglz_prepare_strategy(const PGLZ_Strategy *strategy, int32 src_len,
+					  int32 *good_match_ptr, int32 *good_drop_ptr,
+					  int32 *result_max_ptr)
+{
+	int32		need_rate;
+
+	/*
+	 * If the strategy forbids compression (at all or if source chunk size out
+	 * of range), fail.
+	 */
+	if (strategy->match_size_good <= 0 ||
+		src_len < strategy->min_input_size ||
+		src_len > strategy->max_input_size)
+		return false;
+
+	pglz_match_limits(strategy, good_match_ptr, good_drop_ptr);
+
 	need_rate = strategy->min_comp_rate;
 	if (need_rate < 0)
 		need_rate = 0;
@@ -619,42 +643,296 @@ pglz_compress_hacked(const char *source, int32 src_len, char *dest,
 	if (src_len > (INT_MAX / 100))
 	{
 		/* Approximate to avoid overflow */
-		result_max = (src_len / 100) * (100 - need_rate);
+		*result_max_ptr = (src_len / 100) * (100 - need_rate);
 	}
 	else
     {
-		result_max = (src_len * (100 - need_rate)) / 100;
+		*result_max_ptr = (src_len * (100 - need_rate)) / 100;
     }
 
-	/*
-	 * Experiments suggest that these hash sizes work pretty well. A large
-	 * hash table minimizes collision, but has a higher startup cost. For a
-	 * small input, the startup cost dominates. The table size must be a power
-	 * of two.
-	 */
+	return true;
+}
+
+
+/* ----------
+ * pglz_probe_early -
+ *
+ *		Does the strategy want incompressible input to be given up on
+ *		before all of it has been compressed?  That is the case for
+ *		strategies that already give up early if nothing matches and want
+ *		some compression rate.  PGLZ_strategy_always is never probed.
+ * ----------
+ */
+static inline bool
+pglz_probe_early(const PGLZ_Strategy *strategy, int32 src_len)
+{
+	return strategy->min_comp_rate > 0 &&
+		strategy->first_success_by < src_len;
+}
+
+
+/* ----------
+ * pglz_looks_incompressible -
+ *
+ *		Cheap pre-pass over PGLZ_SAMPLE_SIZE bytes taken in chunks of 8
+ *		from all over the input.  Returns true if their byte histogram is
+ *		nearly flat, which is what compressed, encrypted and random data
+ *		look like.  The sum of the squared byte counts is the number of
+ *		equal byte pairs in the sample; for uniform bytes it is about
+ *		PGLZ_SAMPLE_SIZE * (1 + (PGLZ_SAMPLE_SIZE - 1) / 256), and even
+ *		data that pglz compresses poorly lies well above
+ *		PGLZ_SAMPLE_COLLISIONS.
+ *
+ *		The sum is PGLZ_SAMPLE_SIZE plus twice the number of earlier
+ *		equal bytes each byte is counted with, so it only grows while the
+ *		sample is counted.  Compressible input, the common case, passes
+ *		the limit after a few chunks and the rest is skipped; this is part
+ *		of the setup every datum pays.
+ *
+ *		This also rejects some of the generated worst cases of
+ *		pg_lzcompress_adversary.c, random bytes and the repeated random
+ *		block of adversary_maxmatch, before any work is done, which is why
+ *		the benchmarks compress those with PGLZ_strategy_always.
+ * ----------
+ */
+static inline bool
+pglz_looks_incompressible(const PGLZ_Strategy *strategy,
+						  const char *source, int32 src_len)
+{
+	const unsigned char *sp = (const unsigned char *) source;
+	uint16		counts[256];
+	int32		step;
+	int32		pairs = 0;
+	int			i,
+				j;
+
+	if (!pglz_probe_early(strategy, src_len) ||
+		src_len < 2 * PGLZ_SAMPLE_SIZE)
+		return false;
+
+	memset(counts, 0, sizeof(counts));
+	step = src_len / (PGLZ_SAMPLE_SIZE / 8);
+	for (i = 0; i < PGLZ_SAMPLE_SIZE / 8; i++, sp += step)
+	{
+		for (j = 0; j < 8; j++)
+			pairs += counts[sp[j]]++;
+		if (PGLZ_SAMPLE_SIZE + 2 * pairs >= PGLZ_SAMPLE_COLLISIONS)
+			return false;
+	}
+
+	return true;
+}
+
+
+/* ----------
+ * pglz_probe_end -
+ *
+ *		Returns the input position at which the compressors check whether
+ *		the input got any smaller at all, or the end of the input if there
+ *		is no such check.  Data that the pre-pass cannot tell from text,
+ *		such as packed binary records, then fails after PGLZ_PROBE_SIZE
+ *		bytes of compression instead of most of the input.  The probe is
+ *		late enough that the history has filled, so the literal heavy
+ *		start of an input does not make it fail.
+ * ----------
+ */
+static inline const unsigned char *
+pglz_probe_end(const PGLZ_Strategy *strategy, const char *source,
+			   int32 src_len)
+{
+	if (!pglz_probe_early(strategy, src_len) ||
+		src_len < 4 * PGLZ_PROBE_SIZE)
+		return (const unsigned char *) source + src_len;
+
+	return (const unsigned char *) source + PGLZ_PROBE_SIZE;
+}
+
+
+/* ----------
+ * pglz_probe_failed -
+ *
+ *		The check at probe_end, made once per item by the compressors: if
+ *		the first PGLZ_PROBE_SIZE bytes of input have not got any smaller,
+ *		the rest is unlikely to make up for them, and the compressor should
+ *		fail.  After the check probe_end moves to the end of the input, so
+ *		that it is made only once.
+ * ----------
+ */
+static inline bool
+pglz_probe_failed(const unsigned char **probe_end,
+				  const unsigned char *src_ptr, const unsigned char *src_end,
+				  const char *source, int32 dest_len)
+{
+	if (src_ptr < *probe_end)
+		return false;
+
+	*probe_end = src_end;
+	return dest_len >= src_ptr - (const unsigned char *) source;
+}
+
+
+/* ----------
+ * pglz_hash_size -
+ *
+ *		Experiments suggest that these hash sizes work pretty well. A large
+ *		hash table minimizes collision, but has a higher startup cost. For a
+ *		small input, the startup cost dominates. The table size must be a
+ *		power of two.
+ * ----------
+ */
+static inline int
+pglz_hash_size(int32 src_len)
+{
 	if (src_len < 128)
-		hash_size = 512;
+		return 512;
 	else if (src_len < 256)
-		hash_size = 1024;
+		return 1024;
 	else if (src_len < 512)
-		hash_size = 2048;
+		return 2048;
 	else if (src_len < 1024)
-		hash_size = 4096;
+		return 4096;
 	else
-		hash_size = 8192;
+		return 8192;
+}
+
+
+/* ----------
+ * pglz_compress_context_init -
+ *
+ *		Prepares a caller-owned context for pglz_compress_hacked_ctx().
+ * ----------
+ */
+void
+pglz_compress_context_init(PGLZ_CompressContext *ctx)
+{
+	memset(ctx, 0, sizeof(PGLZ_CompressContext));
+}
+
+
+/* ----------
+ * pglz_compress_context_reset -
+ *
+ *		Forgets all history of previous compressions.  Every compression
+ *		clears the part of the hash table it is going to use, so this is
+ *		not needed between calls; it only drops the stale references into
+ *		previously compressed buffers.
+ * ----------
+ */
+void
+pglz_compress_context_reset(PGLZ_CompressContext *ctx)
+{
+	memset(ctx->hist_start, 0, sizeof(ctx->hist_start));
+	memset(ctx->hist_next, 0, sizeof(ctx->hist_next));
+	memset(ctx->hist_key, 0, sizeof(ctx->hist_key));
+	memset(ctx->hist_pos, 0, sizeof(ctx->hist_pos));
+	memset(ctx->fast_table, 0, sizeof(ctx->fast_table));
+}
+
+
+/* ----------
+ * pglz_compress_hacked -
+ *
+ *		Compresses source into dest using strategy and the history of
+ *		a context shared by all callers.  Not reentrant.
+ * ----------
+ */
+int32
+pglz_compress_hacked(const char *source, int32 src_len, char *dest,
+			  const PGLZ_Strategy *strategy)
+{
+	return pglz_compress_hacked_ctx(&default_context, source, src_len, dest,
+									strategy);
+}
+
+
+/* ----------
+ * pglz_compress_hacked_impl -
+ *
+ *		The body of pglz_compress_hacked_ctx().  It is always inlined, so
+ *		callers passing a constant src_len get a copy where the hash mask,
+ *		the sizes of the memset and the loop bounds are compile-time
+ *		constants.
+ * ----------
+ */
+static pg_attribute_always_inline int32
+pglz_compress_hacked_impl(PGLZ_CompressContext *ctx, const char *source,
+						  int32 src_len, char *dest, int32 dest_size,
+						  const PGLZ_Strategy *strategy, int32 prefix_len)
+{
+	unsigned char *dest_ptr = (unsigned char *) dest;
+	unsigned char *dest_start = dest_ptr;
+	uint16			hist_next = 1;
+    uint16          hist_idx;
+	const unsigned char *src_ptr = (const unsigned char*)source;
+	const unsigned char *src_end = (const unsigned char*)source + src_len;
+    const unsigned char *compress_src_end = src_end - 4;
+	unsigned char control_dummy = 0;
+	unsigned char *control_ptr = &control_dummy;
+	unsigned char control_byte = 0;
+	unsigned char control_pos = 0;
+	bool		found_match = false;
+	const unsigned char *probe_end;
+	int32		match_len;
+	int32		match_offset;
+	int32		good_match;
+	int32		good_drop;
+	int32		result_size;
+	int32		result_max;
+	int			hash_size;
+	uint16		mask;
+
+
+	PGLZ_STATS_ADD(compress_calls, 1);
+
+	/*
+	 * Our fallback strategy is the default.
+	 */
+	if (strategy == NULL)
+    {
+		strategy = PGLZ_strategy_default;
+    }
+
+	if (!pglz_prepare_strategy(strategy, src_len, &good_match, &good_drop,
+							   &result_max) ||
+		pglz_looks_incompressible(strategy, source, src_len))
+		return -1;
+	probe_end = pglz_probe_end(strategy, source, src_len);
+
+	/*
+	 * The checks below let the output run up to 3 bytes past result_max,
+	 * which must still be inside dest.
+	 */
+	result_max = Min(result_max, dest_size - 3);
+
+	hash_size = pglz_hash_size(src_len + prefix_len);
 	mask = hash_size - 1;
 
 	/*
 	 * Initialize the history lists to empty.  We do not need to zero the
-	 * hist_entries[] array; its entries are initialized as they are used.
+	 * history entries; they are initialized as they are used.
 	 */
-	memset(hist_start, 0, hash_size * sizeof(int16));
+	memset(ctx->hist_start, 0, hash_size * sizeof(int16));
 
     /*
      * Initialize INVALID_ENTRY for stopping during lookup.
      */
-    hist_entries[INVALID_ENTRY].pos = src_end;
-    hist_entries[INVALID_ENTRY].hist_idx = hash_size;
+    ctx->hist_key[INVALID_ENTRY] = hash_size;
+
+	/*
+	 * Enter the prefix into the history without emitting anything.  The
+	 * rolling hash reads 4 bytes ahead, into the source.
+	 */
+	if (prefix_len > 0 && src_len > 4)
+	{
+		const unsigned char *prefix_ptr = src_ptr - prefix_len;
+
+		hist_idx = pglz_hist_idx(prefix_ptr, mask);
+		while (prefix_ptr < src_ptr)
+		{
+			hist_next = pglz_hist_add(ctx, hist_next, &hist_idx, prefix_ptr, mask);
+			prefix_ptr++;
+		}
+	}
 
     /*
      * Calculate initial hash value.
@@ -685,6 +963,10 @@ pglz_compress_hacked(const char *source, int32 src_len, char *dest,
 		if (!found_match && dest_ptr - dest_start >= strategy->first_success_by)
 			return -1;
 
+		if (pglz_probe_failed(&probe_end, src_ptr, src_end, source,
+							  dest_ptr - dest_start))
+			return -1;
+
 		/*
 		 * Refresh control byte if needed.
 		 */
@@ -698,7 +980,7 @@ pglz_compress_hacked(const char *source, int32 src_len, char *dest,
 		/*
 		 * Try to find a match in the history
 		 */
-		if (pglz_find_match(hist_idx, src_ptr, compress_src_end, &match_len,
+		if (pglz_find_match(ctx, hist_idx, src_ptr, compress_src_end, &match_len,
 							&match_offset, good_match, good_drop))
 		{
 			/*
@@ -707,9 +989,13 @@ pglz_compress_hacked(const char *source, int32 src_len, char *dest,
 			 */
             control_byte |= control_pos;														
             dest_ptr = pglz_out_tag(dest_ptr, match_len, match_offset);
+			PGLZ_STATS_ADD(matches, 1);
+			PGLZ_STATS_ADD(match_bytes, match_len);
+			PGLZ_STATS_CLASS(match_length, match_len);
+			PGLZ_STATS_CLASS(match_offset, match_offset);
 			while (match_len--)
 			{
-				hist_next = pglz_hist_add(hist_next, &hist_idx, src_ptr, mask);
+				hist_next = pglz_hist_add(ctx, hist_next, &hist_idx, src_ptr, mask);
 				src_ptr++;			/* Do not do this ++ in the line above! */
 				/* The macro would do it four times - Jan.  */
 			}
@@ -720,8 +1006,9 @@ pglz_compress_hacked(const char *source, int32 src_len, char *dest,
 			/*
 			 * No match found. Copy one literal byte.
 			 */
-			hist_next = pglz_hist_add(hist_next, &hist_idx, src_ptr, mask);
+			hist_next = pglz_hist_add(ctx, hist_next, &hist_idx, src_ptr, mask);
             *(dest_ptr)++ = (unsigned char)(*src_ptr);
+			PGLZ_STATS_ADD(literals, 1);
 			src_ptr++;				/* Do not do this ++ in the line above! */
 			/* The macro would do it four times - Jan.  */
 		}
@@ -752,6 +1039,7 @@ pglz_compress_hacked(const char *source, int32 src_len, char *dest,
             control_pos = 1;															
         }																		
         *(dest_ptr)++ = (unsigned char)(*src_ptr);
+        PGLZ_STATS_ADD(literals, 1);
         src_ptr++;
         control_pos <<= 1;
 	}
@@ -769,3 +1057,1106 @@ pglz_compress_hacked(const char *source, int32 src_len, char *dest,
 	/* success */
 	return result_size;
 }
+
+
+/* ----------
+ * pglz_compress_hacked_2k, pglz_compress_hacked_4k, pglz_compress_hacked_8k -
+ *
+ *		Specializations for the slice sizes TOAST and the benchmarks use
+ *		most.  Small slices pay the most per byte for the setup, which is
+ *		what these save.
+ * ----------
+ */
+static int32
+pglz_compress_hacked_2k(PGLZ_CompressContext *ctx, const char *source,
+						char *dest, int32 dest_size, const PGLZ_Strategy *strategy)
+{
+	return pglz_compress_hacked_impl(ctx, source, 2048, dest, dest_size, strategy, 0);
+}
+
+static int32
+pglz_compress_hacked_4k(PGLZ_CompressContext *ctx, const char *source,
+						char *dest, int32 dest_size, const PGLZ_Strategy *strategy)
+{
+	return pglz_compress_hacked_impl(ctx, source, 4096, dest, dest_size, strategy, 0);
+}
+
+static int32
+pglz_compress_hacked_8k(PGLZ_CompressContext *ctx, const char *source,
+						char *dest, int32 dest_size, const PGLZ_Strategy *strategy)
+{
+	return pglz_compress_hacked_impl(ctx, source, 8192, dest, dest_size, strategy, 0);
+}
+
+
+/* ----------
+ * pglz_compress_hacked_sized -
+ *
+ *		Passes inputs of a specialized size on to their specialization.
+ * ----------
+ */
+static inline int32
+pglz_compress_hacked_sized(PGLZ_CompressContext *ctx, const char *source,
+						   int32 src_len, char *dest, int32 dest_size,
+						   const PGLZ_Strategy *strategy)
+{
+	switch (src_len)
+	{
+		case 2048:
+			return pglz_compress_hacked_2k(ctx, source, dest, dest_size, strategy);
+		case 4096:
+			return pglz_compress_hacked_4k(ctx, source, dest, dest_size, strategy);
+		case 8192:
+			return pglz_compress_hacked_8k(ctx, source, dest, dest_size, strategy);
+	}
+
+	return pglz_compress_hacked_impl(ctx, source, src_len, dest, dest_size,
+									 strategy, 0);
+}
+
+
+/* ----------
+ * pglz_compress_hacked_ctx -
+ *
+ *		Compresses source into dest using strategy and the history tables
+ *		of ctx. Returns the number of bytes written in buffer dest, or -1
+ *		if compression fails.
+ * ----------
+ */
+int32
+pglz_compress_hacked_ctx(PGLZ_CompressContext *ctx, const char *source,
+						 int32 src_len, char *dest,
+						 const PGLZ_Strategy *strategy)
+{
+	return pglz_compress_hacked_sized(ctx, source, src_len, dest, PG_INT32_MAX,
+									  strategy);
+}
+
+
+/* ----------
+ * pglz_compress_bounded_ctx -
+ *
+ *		Like pglz_compress_hacked_ctx(), but never writes more than
+ *		dest_size bytes to dest.  The output is the same as long as it
+ *		takes at most dest_size - 4 bytes, else this fails.
+ * ----------
+ */
+int32
+pglz_compress_bounded_ctx(PGLZ_CompressContext *ctx, const char *source,
+						  int32 src_len, char *dest, int32 dest_size,
+						  const PGLZ_Strategy *strategy)
+{
+	return pglz_compress_hacked_sized(ctx, source, src_len, dest, dest_size,
+									  strategy);
+}
+
+
+/* ----------
+ * pglz_compress_bounded -
+ *
+ *		pglz_compress_bounded_ctx() with a context shared by all callers.
+ *		Not reentrant.
+ * ----------
+ */
+int32
+pglz_compress_bounded(const char *source, int32 src_len, char *dest,
+					  int32 dest_size, const PGLZ_Strategy *strategy)
+{
+	return pglz_compress_bounded_ctx(&default_context, source, src_len, dest,
+									 dest_size, strategy);
+}
+
+
+/* ----------
+ * pglz_compress_primed_ctx -
+ *
+ *		Like pglz_compress_hacked_ctx(), but the prefix_len bytes before
+ *		source in memory are entered into the history first, so that the
+ *		output may refer back into them.  The decompressor must then make
+ *		the same bytes appear before dest.  prefix_len must not exceed
+ *		PGLZ_HISTORY_SIZE.
+ * ----------
+ */
+int32
+pglz_compress_primed_ctx(PGLZ_CompressContext *ctx, const char *source,
+						 int32 src_len, char *dest,
+						 const PGLZ_Strategy *strategy, int32 prefix_len)
+{
+	Assert(prefix_len >= 0 && prefix_len <= PGLZ_HISTORY_SIZE);
+
+	return pglz_compress_hacked_impl(ctx, source, src_len, dest, PG_INT32_MAX,
+									 strategy, prefix_len);
+}
+
+
+/* ----------
+ * pglz_fast_idx -
+ *
+ *		Computes the slot of the single-probe hash table for the next 4
+ *		characters in the input.  Multiplicative hashing spreads the keys
+ *		much better than the shift-and-xor key of the history lists.
+ * ----------
+ */
+static inline uint32
+pglz_fast_idx(const unsigned char *s, uint16 mask)
+{
+	return ((pglz_read32(s) * 2654435761U) >> 19) & mask;
+}
+
+
+/* ----------
+ * pglz_compress_fast -
+ *
+ *		pglz_compress_fast_ctx() with a context shared by all callers.
+ *		Not reentrant.
+ * ----------
+ */
+int32
+pglz_compress_fast(const char *source, int32 src_len, char *dest,
+				   const PGLZ_Strategy *strategy)
+{
+	return pglz_compress_fast_ctx(&default_context, source, src_len, dest,
+								  strategy);
+}
+
+
+/* ----------
+ * pglz_compress_fast_ctx -
+ *
+ *		Compresses source into dest in the usual pglz format, trading ratio
+ *		for speed.  Instead of walking the history lists, every position
+ *		looks at the single previous position with the same hash key of its
+ *		next 4 bytes, and takes that match if the bytes really are equal.
+ *		Only the first and the second to last positions of a match are
+ *		remembered.  good_match and good_drop of the strategy do not apply.
+ *		Returns the number of bytes written in buffer dest, or -1 if
+ *		compression fails.
+ * ----------
+ */
+int32
+pglz_compress_fast_ctx(PGLZ_CompressContext *ctx, const char *source,
+					   int32 src_len, char *dest,
+					   const PGLZ_Strategy *strategy)
+{
+	unsigned char *dest_ptr = (unsigned char *) dest;
+	unsigned char *dest_start = dest_ptr;
+	const unsigned char *src_start = (const unsigned char *) source;
+	const unsigned char *src_ptr = src_start;
+	const unsigned char *src_end = src_start + src_len;
+	const unsigned char *compress_src_end = src_end - 4;
+	unsigned char control_dummy = 0;
+	unsigned char *control_ptr = &control_dummy;
+	unsigned char control_byte = 0;
+	unsigned char control_pos = 0;
+	bool		found_match = false;
+	const unsigned char *probe_end;
+	int32		good_match;
+	int32		good_drop;
+	int32		result_size;
+	int32		result_max;
+	uint16		mask;
+
+	/*
+	 * Our fallback strategy is the default.
+	 */
+	if (strategy == NULL)
+		strategy = PGLZ_strategy_default;
+
+	if (!pglz_prepare_strategy(strategy, src_len, &good_match, &good_drop,
+							   &result_max) ||
+		pglz_looks_incompressible(strategy, source, src_len))
+		return -1;
+	probe_end = pglz_probe_end(strategy, source, src_len);
+
+	/*
+	 * A zeroed table points every key at the start of the input, which is a
+	 * valid candidate that is verified like any other.
+	 */
+	mask = pglz_hash_size(src_len) - 1;
+	memset(ctx->fast_table, 0, (mask + 1) * sizeof(int32));
+
+	while (src_ptr < compress_src_end)
+	{
+		uint32		idx;
+		const unsigned char *match_ptr;
+		int32		match_offset;
+
+		/*
+		 * If we already exceeded the maximum result size, fail.
+		 *
+		 * We check once per loop; since the loop body could emit as many as 4
+		 * bytes (a control byte and 3-byte tag), PGLZ_MAX_OUTPUT() had better
+		 * allow 4 slop bytes.
+		 */
+		if (dest_ptr - dest_start >= result_max)
+			return -1;
+
+		/*
+		 * If we've emitted more than first_success_by bytes without finding
+		 * anything compressible at all, fail.
+		 */
+		if (!found_match && dest_ptr - dest_start >= strategy->first_success_by)
+			return -1;
+
+		if (pglz_probe_failed(&probe_end, src_ptr, src_end, source,
+							  dest_ptr - dest_start))
+			return -1;
+
+		/*
+		 * Refresh control byte if needed.
+		 */
+		if ((control_pos & 0xff) == 0)
+		{
+			*(control_ptr) = control_byte;
+			control_ptr = (dest_ptr)++;
+			control_byte = 0;
+			control_pos = 1;
+		}
+
+		/*
+		 * Probe the table and replace the candidate with this position.
+		 */
+		idx = pglz_fast_idx(src_ptr, mask);
+		match_ptr = src_start + ctx->fast_table[idx];
+		ctx->fast_table[idx] = src_ptr - src_start;
+		match_offset = src_ptr - match_ptr;
+
+		if (match_offset > 0 && match_offset <= PGLZ_MAX_OFFSET &&
+			pglz_read32(src_ptr) == pglz_read32(match_ptr))
+		{
+			int32		len_bound = Min(compress_src_end - src_ptr, PGLZ_MAX_MATCH);
+			int32		match_len;
+
+			match_len = pglz_compare(4, len_bound, src_ptr + 4, match_ptr + 4);
+			match_len = Min(match_len, len_bound);
+			if (match_len > 2)
+			{
+				control_byte |= control_pos;
+				dest_ptr = pglz_out_tag(dest_ptr, match_len, match_offset);
+				src_ptr += match_len;
+				found_match = true;
+
+				/*
+				 * Remember a position near the end of the match, it is
+				 * likely to start the next one.
+				 */
+				ctx->fast_table[pglz_fast_idx(src_ptr - 2, mask)] =
+					src_ptr - 2 - src_start;
+				control_pos <<= 1;
+				continue;
+			}
+		}
+
+		/*
+		 * No match found. Copy one literal byte.
+		 */
+		*(dest_ptr)++ = *src_ptr++;
+		control_pos <<= 1;
+	}
+
+	while (src_ptr < src_end)
+	{
+		if (dest_ptr - dest_start >= result_max)
+			return -1;
+
+		if ((control_pos & 0xff) == 0)
+		{
+			*(control_ptr) = control_byte;
+			control_ptr = (dest_ptr)++;
+			control_byte = 0;
+			control_pos = 1;
+		}
+		*(dest_ptr)++ = *src_ptr++;
+		control_pos <<= 1;
+	}
+
+	/*
+	 * Write out the last control byte and check that we haven't overrun the
+	 * output size allowed by the strategy.
+	 */
+	*control_ptr = control_byte;
+	result_size = dest_ptr - dest_start;
+	if (result_size >= result_max)
+		return -1;
+
+	/* success */
+	return result_size;
+}
+
+
+/* ----------
+ * pglz_compress_high -
+ *
+ *		pglz_compress_high_ctx() with a context shared by all callers.
+ *		Not reentrant.
+ * ----------
+ */
+int32
+pglz_compress_high(const char *source, int32 src_len, char *dest,
+				   const PGLZ_Strategy *strategy)
+{
+	return pglz_compress_high_ctx(&default_context, source, src_len, dest,
+								  strategy);
+}
+
+
+/* ----------
+ * pglz_compress_high_ctx -
+ *
+ *		Compresses source into dest in the usual pglz format, trading speed
+ *		for ratio.  The history lists are searched as in
+ *		pglz_compress_hacked_ctx(), but good_match is PGLZ_MAX_MATCH and
+ *		does not decay, so the lists are walked to their end unless a
+ *		longest possible match shows up.  Matching is lazy: before a match
+ *		is taken, the next position is looked up too, and if it has a
+ *		longer match, the current byte becomes a literal.  Returns the
+ *		number of bytes written in buffer dest, or -1 if compression fails.
+ * ----------
+ */
+int32
+pglz_compress_high_ctx(PGLZ_CompressContext *ctx, const char *source,
+					   int32 src_len, char *dest,
+					   const PGLZ_Strategy *strategy)
+{
+	unsigned char *dest_ptr = (unsigned char *) dest;
+	unsigned char *dest_start = dest_ptr;
+	uint16		hist_next = 1;
+	uint16		hist_idx;
+	const unsigned char *src_ptr = (const unsigned char *) source;
+	const unsigned char *src_end = (const unsigned char *) source + src_len;
+	const unsigned char *compress_src_end = src_end - 4;
+	unsigned char control_dummy = 0;
+	unsigned char *control_ptr = &control_dummy;
+	unsigned char control_byte = 0;
+	unsigned char control_pos = 0;
+	bool		found_match = false;
+	bool		have_match = false;
+	int32		match_len;
+	int32		match_offset;
+	int32		next_len;
+	int32		next_offset;
+	int32		good_match;
+	int32		good_drop;
+	int32		result_size;
+	int32		result_max;
+	int			hash_size;
+	uint16		mask;
+	const unsigned char *probe_end;
+
+	/*
+	 * Our fallback strategy is the default.
+	 */
+	if (strategy == NULL)
+		strategy = PGLZ_strategy_default;
+
+	if (!pglz_prepare_strategy(strategy, src_len, &good_match, &good_drop,
+							   &result_max) ||
+		pglz_looks_incompressible(strategy, source, src_len))
+		return -1;
+	probe_end = pglz_probe_end(strategy, source, src_len);
+	good_match = PGLZ_MAX_MATCH;
+	good_drop = 0;
+
+	hash_size = pglz_hash_size(src_len);
+	mask = hash_size - 1;
+
+	memset(ctx->hist_start, 0, hash_size * sizeof(int16));
+	ctx->hist_key[INVALID_ENTRY] = hash_size;
+
+	hist_idx = pglz_hist_idx(src_ptr, mask);
+
+	while (src_ptr < compress_src_end)
+	{
+		/*
+		 * If we already exceeded the maximum result size, fail.
+		 *
+		 * We check once per loop; since the loop body could emit as many as 4
+		 * bytes (a control byte and 3-byte tag), PGLZ_MAX_OUTPUT() had better
+		 * allow 4 slop bytes.
+		 */
+		if (dest_ptr - dest_start >= result_max)
+			return -1;
+
+		/*
+		 * If we've emitted more than first_success_by bytes without finding
+		 * anything compressible at all, fail.
+		 */
+		if (!found_match && dest_ptr - dest_start >= strategy->first_success_by)
+			return -1;
+
+		if (pglz_probe_failed(&probe_end, src_ptr, src_end, source,
+							  dest_ptr - dest_start))
+			return -1;
+
+		/*
+		 * Refresh control byte if needed.
+		 */
+		if ((control_pos & 0xff) == 0)
+		{
+			*(control_ptr) = control_byte;
+			control_ptr = (dest_ptr)++;
+			control_byte = 0;
+			control_pos = 1;
+		}
+
+		/*
+		 * The match for this position may be left over from the lookahead
+		 * of the previous one.
+		 */
+		if (!have_match)
+			have_match = pglz_find_match(ctx, hist_idx, src_ptr,
+										 compress_src_end, &match_len,
+										 &match_offset, good_match,
+										 good_drop);
+
+		if (!have_match)
+		{
+			/*
+			 * No match found. Copy one literal byte.
+			 */
+			hist_next = pglz_hist_add(ctx, hist_next, &hist_idx, src_ptr, mask);
+			*(dest_ptr)++ = *src_ptr++;
+			control_pos <<= 1;
+			continue;
+		}
+
+		/*
+		 * Add this position to the history and look whether the next one
+		 * would do better.  If so, emit a literal and carry the next match
+		 * over to the next iteration.
+		 */
+		hist_next = pglz_hist_add(ctx, hist_next, &hist_idx, src_ptr, mask);
+		if (match_len < good_match && src_ptr + 1 < compress_src_end &&
+			pglz_find_match(ctx, hist_idx, src_ptr + 1, compress_src_end,
+							&next_len, &next_offset, good_match, good_drop) &&
+			next_len > match_len)
+		{
+			*(dest_ptr)++ = *src_ptr++;
+			match_len = next_len;
+			match_offset = next_offset;
+			control_pos <<= 1;
+			continue;
+		}
+
+		/*
+		 * Create the tag and add history entries for the rest of the
+		 * matched characters.
+		 */
+		control_byte |= control_pos;
+		dest_ptr = pglz_out_tag(dest_ptr, match_len, match_offset);
+		src_ptr++;
+		while (--match_len)
+		{
+			hist_next = pglz_hist_add(ctx, hist_next, &hist_idx, src_ptr, mask);
+			src_ptr++;
+		}
+		found_match = true;
+		have_match = false;
+		control_pos <<= 1;
+	}
+
+	while (src_ptr < src_end)
+	{
+		if (dest_ptr - dest_start >= result_max)
+			return -1;
+
+		if ((control_pos & 0xff) == 0)
+		{
+			*(control_ptr) = control_byte;
+			control_ptr = (dest_ptr)++;
+			control_byte = 0;
+			control_pos = 1;
+		}
+		*(dest_ptr)++ = *src_ptr++;
+		control_pos <<= 1;
+	}
+
+	/*
+	 * Write out the last control byte and check that we haven't overrun the
+	 * output size allowed by the strategy.
+	 */
+	*control_ptr = control_byte;
+	result_size = dest_ptr - dest_start;
+	if (result_size >= result_max)
+		return -1;
+
+	/* success */
+	return result_size;
+}
+
+
+/* ----------
+ * pglz2_hash_bits -
+ *
+ *		Bits of the pglz2 hash table for src_len bytes of input.  A table
+ *		larger than the input only costs its initialization.
+ * ----------
+ */
+static inline int
+pglz2_hash_bits(int32 src_len)
+{
+	int			bits = 9;
+
+	while (bits < 16 && (1 << bits) < src_len)
+		bits++;
+	return bits;
+}
+
+
+static inline uint32
+pglz2_hash(const unsigned char *s, int bits)
+{
+	return (pglz_read32(s) * 2654435761U) >> (32 - bits);
+}
+
+
+/* ----------
+ * pglz2_hist_add -
+ *
+ *		Makes input offset pos the head of the chain of its hash key.
+ *		Returns the previous head.
+ * ----------
+ */
+static inline int32
+pglz2_hist_add(PGLZ2_CompressContext *ctx, const unsigned char *src_start,
+			   int32 pos, int bits)
+{
+	uint32		h = pglz2_hash(src_start + pos, bits);
+	int32		prev = ctx->head[h];
+
+	ctx->prev[pos & (PGLZ2_WINDOW_SIZE - 1)] = prev;
+	ctx->head[h] = pos;
+	return prev;
+}
+
+
+/* ----------
+ * pglz2_find_match -
+ *
+ *		Adds input offset pos to the history and walks the older positions
+ *		with its hash key, at most PGLZ2_MAX_CHAIN of them and no further
+ *		back than PGLZ2_MAX_OFFSET.  good_match drops at each step as in
+ *		pglz_find_match().  Returns the length of the longest match and
+ *		stores its offset, or returns 0.
+ *
+ *		Entries of prev are only overwritten PGLZ2_WINDOW_SIZE positions
+ *		later, so the links of all positions within reach are intact.
+ * ----------
+ */
+static inline int32
+pglz2_find_match(PGLZ2_CompressContext *ctx, const unsigned char *src_start,
+				 int32 pos, int32 len_bound, int bits, int32 good_match,
+				 int32 good_drop, int32 *offset_ptr)
+{
+	const unsigned char *input = src_start + pos;
+	uint32		input4 = pglz_read32(input);
+	int32		cand = pglz2_hist_add(ctx, src_start, pos, bits);
+	int32		best_len = 0;
+	int			chain = PGLZ2_MAX_CHAIN;
+
+	while (cand >= 0 && pos - cand <= PGLZ2_MAX_OFFSET && chain-- > 0)
+	{
+		const unsigned char *hp = src_start + cand;
+
+		if (pglz_read32(hp) == input4 && hp[best_len] == input[best_len])
+		{
+			int32		len = pglz_compare(4, len_bound, input + 4, hp + 4);
+
+			len = Min(len, len_bound);
+			if (len > best_len)
+			{
+				best_len = len;
+				*offset_ptr = pos - cand;
+				if (len >= good_match || len >= len_bound)
+					break;
+			}
+		}
+
+		good_match -= (good_match * good_drop) >> 7;
+		cand = ctx->prev[cand & (PGLZ2_WINDOW_SIZE - 1)];
+	}
+
+	return best_len;
+}
+
+
+/* ----------
+ * pglz2_out_tag -
+ *
+ *		Outputs a pglz2 tag, see pglz2_compress_ctx() for the layout.
+ * ----------
+ */
+static inline unsigned char *
+pglz2_out_tag(unsigned char *dest_ptr, int32 match_len, int32 match_offset)
+{
+	int32		len_code = Min(match_len - 3, 15);
+
+	if (match_offset < 0x0f00)
+	{
+		*(dest_ptr++) = (unsigned char) (((match_offset & 0xf00) >> 4) | len_code);
+		*(dest_ptr++) = (unsigned char) (match_offset & 0xff);
+	}
+	else
+	{
+		*(dest_ptr++) = (unsigned char) (0xf0 | len_code);
+		*(dest_ptr++) = (unsigned char) (match_offset & 0xff);
+		*(dest_ptr++) = (unsigned char) (match_offset >> 8);
+	}
+
+	if (len_code == 15)
+	{
+		int32		extra = match_len - 18;
+
+		if (extra < 255)
+			*(dest_ptr++) = (unsigned char) extra;
+		else
+		{
+			extra -= 255;
+			*(dest_ptr++) = 255;
+			*(dest_ptr++) = (unsigned char) (extra & 0xff);
+			*(dest_ptr++) = (unsigned char) (extra >> 8);
+		}
+	}
+	return dest_ptr;
+}
+
+
+/* ----------
+ * Context used by pglz2_compress()
+ * ----------
+ */
+static PGLZ2_CompressContext pglz2_default_context;
+
+
+/* ----------
+ * pglz2_compress -
+ *
+ *		pglz2_compress_ctx() with a context shared by all callers.
+ *		Not reentrant.
+ * ----------
+ */
+int32
+pglz2_compress(const char *source, int32 src_len, char *dest,
+			   const PGLZ_Strategy *strategy)
+{
+	return pglz2_compress_ctx(&pglz2_default_context, source, src_len, dest,
+							  strategy);
+}
+
+
+/* ----------
+ * pglz2_compress_ctx -
+ *
+ *		Compresses source into dest as a pglz2 stream, which dest must have
+ *		PGLZ2_MAX_OUTPUT(src_len) bytes for.  Returns the number of bytes
+ *		written in buffer dest, or -1 if compression fails.
+ *
+ *		The stream is a byte holding PGLZ2_VERSION followed by items in
+ *		groups of 8 behind a control byte, as in pglz.  Only the tags
+ *		differ.  A tag starts like a pglz tag,
+ *
+ *			7---T1--0  7---T2--0
+ *			OOOO LLLL  OOOO OOOO
+ *
+ *		with offsets of up to 0xeff in 12 bits.  An offset nibble of 0xf
+ *		means that T2 is the low and a T3 the high byte of an offset of up
+ *		to PGLZ2_MAX_OFFSET instead.  A length nibble of 0xf is followed by
+ *		a byte to add to 18, as in pglz, and if that byte is 0xff, by two
+ *		bytes of a 16-bit little-endian number to add on top, which allows
+ *		lengths up to PGLZ2_MAX_MATCH.  So one tag takes 2 to 6 bytes.
+ *
+ *		8kB pages and WAL records repeat at distances the 4kB window of
+ *		pglz cannot reach, and long runs of zeroes take one tag instead of
+ *		one per 273 bytes.  The history is a chained hash table over the
+ *		last PGLZ2_WINDOW_SIZE input positions that keeps input offsets,
+ *		as the 16-bit entries of PGLZ_CompressContext cannot tell those
+ *		distances apart.  The strategy is applied as by
+ *		pglz_compress_hacked().
+ * ----------
+ */
+int32
+pglz2_compress_ctx(PGLZ2_CompressContext *ctx, const char *source,
+				   int32 src_len, char *dest, const PGLZ_Strategy *strategy)
+{
+	unsigned char *dest_ptr = (unsigned char *) dest;
+	unsigned char *dest_start = dest_ptr;
+	const unsigned char *src_start = (const unsigned char *) source;
+	const unsigned char *src_ptr = src_start;
+	const unsigned char *src_end = src_start + src_len;
+	const unsigned char *compress_src_end = src_end - 4;
+	unsigned char control_dummy = 0;
+	unsigned char *control_ptr = &control_dummy;
+	unsigned char control_byte = 0;
+	unsigned char control_pos = 0;
+	bool		found_match = false;
+	const unsigned char *probe_end;
+	int32		good_match;
+	int32		good_drop;
+	int32		result_size;
+	int32		result_max;
+	int			bits;
+
+	/*
+	 * Our fallback strategy is the default.
+	 */
+	if (strategy == NULL)
+		strategy = PGLZ_strategy_default;
+
+	if (!pglz_prepare_strategy(strategy, src_len, &good_match, &good_drop,
+							   &result_max) ||
+		pglz_looks_incompressible(strategy, source, src_len))
+		return -1;
+	probe_end = pglz_probe_end(strategy, source, src_len);
+
+	/* -1 in head ends every chain; prev is only reached through head */
+	bits = pglz2_hash_bits(src_len);
+	memset(ctx->head, 0xff, sizeof(int32) << bits);
+
+	*(dest_ptr)++ = PGLZ2_VERSION;
+
+	while (src_ptr < compress_src_end)
+	{
+		int32		pos = src_ptr - src_start;
+		int32		len_bound = Min(compress_src_end - src_ptr, PGLZ2_MAX_MATCH);
+		int32		match_len;
+		int32		match_offset = 0;
+
+		/*
+		 * If we already exceeded the maximum result size, fail.
+		 *
+		 * We check once per loop; since the loop body could emit as many as 7
+		 * bytes (a control byte and 6-byte tag), PGLZ2_MAX_OUTPUT() had
+		 * better allow 7 slop bytes besides the version byte.
+		 */
+		if (dest_ptr - dest_start >= result_max)
+			return -1;
+
+		/*
+		 * If we've emitted more than first_success_by bytes without finding
+		 * anything compressible at all, fail.
+		 */
+		if (!found_match && dest_ptr - dest_start >= strategy->first_success_by)
+			return -1;
+
+		if (pglz_probe_failed(&probe_end, src_ptr, src_end, source,
+							  dest_ptr - dest_start))
+			return -1;
+
+		/*
+		 * Refresh control byte if needed.
+		 */
+		if ((control_pos & 0xff) == 0)
+		{
+			*(control_ptr) = control_byte;
+			control_ptr = (dest_ptr)++;
+			control_byte = 0;
+			control_pos = 1;
+		}
+
+		match_len = pglz2_find_match(ctx, src_start, pos, len_bound, bits,
+									 good_match, good_drop, &match_offset);
+		if (match_len > 3)
+		{
+			int32		i;
+
+			control_byte |= control_pos;
+			dest_ptr = pglz2_out_tag(dest_ptr, match_len, match_offset);
+			found_match = true;
+
+			/* the positions covered by the match go into the history too */
+			for (i = 1; i < match_len; i++)
+				pglz2_hist_add(ctx, src_start, pos + i, bits);
+			src_ptr += match_len;
+		}
+		else
+		{
+			/*
+			 * No match found. Copy one literal byte.
+			 */
+			*(dest_ptr)++ = *src_ptr++;
+		}
+		control_pos <<= 1;
+	}
+
+	while (src_ptr < src_end)
+	{
+		if (dest_ptr - dest_start >= result_max)
+			return -1;
+
+		if ((control_pos & 0xff) == 0)
+		{
+			*(control_ptr) = control_byte;
+			control_ptr = (dest_ptr)++;
+			control_byte = 0;
+			control_pos = 1;
+		}
+		*(dest_ptr)++ = *src_ptr++;
+		control_pos <<= 1;
+	}
+
+	/*
+	 * Write out the last control byte and check that we haven't overrun the
+	 * output size allowed by the strategy.
+	 */
+	*control_ptr = control_byte;
+	result_size = dest_ptr - dest_start;
+	if (result_size >= result_max)
+		return -1;
+
+	/* success */
+	return result_size;
+}
+
+
+/* ----------
+ * pglz_compress_level -
+ *
+ *		pglz_compress_level_ctx() with a context shared by all callers.
+ *		Not reentrant.
+ * ----------
+ */
+int32
+pglz_compress_level(const char *source, int32 src_len, char *dest,
+					const PGLZ_StrategyExt *strategy)
+{
+	return pglz_compress_level_ctx(&default_context, source, src_len, dest,
+								   strategy);
+}
+
+
+/* ----------
+ * pglz_compress_level_ctx -
+ *
+ *		Compresses source into dest with the compressor chosen by the level
+ *		of strategy, which also passes its PGLZ_Strategy on.  NULL means
+ *		the default strategy and level.
+ * ----------
+ */
+int32
+pglz_compress_level_ctx(PGLZ_CompressContext *ctx, const char *source,
+						int32 src_len, char *dest,
+						const PGLZ_StrategyExt *strategy)
+{
+	if (strategy == NULL)
+		return pglz_compress_hacked_ctx(ctx, source, src_len, dest, NULL);
+
+	switch (strategy->level)
+	{
+		case PGLZ_LEVEL_FAST:
+			return pglz_compress_fast_ctx(ctx, source, src_len, dest,
+										  &strategy->strategy);
+		case PGLZ_LEVEL_HIGH:
+			return pglz_compress_high_ctx(ctx, source, src_len, dest,
+										  &strategy->strategy);
+		case PGLZ_LEVEL_DEFAULT:
+			break;
+	}
+
+	return pglz_compress_hacked_ctx(ctx, source, src_len, dest,
+									&strategy->strategy);
+}
+
+
+/* ----------
+ * pglz_stream_begin -
+ *
+ *		Starts a streaming compression.  Only the match parameters of
+ *		strategy are used: a stream is never refused, so the input size
+ *		limits, the compression rate and first_success_by do not apply.
+ *		NULL means the default strategy.
+ * ----------
+ */
+void
+pglz_stream_begin(PGLZ_StreamState *state, const PGLZ_Strategy *strategy)
+{
+	if (strategy == NULL)
+		strategy = PGLZ_strategy_default;
+
+	pglz_match_limits(strategy, &state->good_match, &state->good_drop);
+
+	memset(state->ctx.hist_start, 0, sizeof(state->ctx.hist_start));
+	state->ctx.hist_key[INVALID_ENTRY] = PGLZ_MAX_HISTORY_LISTS;
+	state->buf_len = 0;
+	state->buf_pos = 0;
+	state->hist_next = 1;
+	state->hist_idx = 0;
+	state->hist_started = false;
+	state->group_len = 0;
+	state->control_pos = 0;
+	state->raw_size = 0;
+}
+
+
+/* ----------
+ * pglz_stream_compress -
+ *
+ *		Compresses the buffered input up to buf + stop and writes the
+ *		completed control groups to dest.  Matches may run past stop up to
+ *		the last 4 buffered bytes.  If final, the rest of the buffer is
+ *		emitted as literals too, and so is the unfinished control group.
+ *		Returns the number of bytes written.
+ * ----------
+ */
+static int32
+pglz_stream_compress(PGLZ_StreamState *state, int32 stop, bool final,
+					 char *dest)
+{
+	PGLZ_CompressContext *ctx = &state->ctx;
+	unsigned char *dest_ptr = (unsigned char *) dest;
+	const unsigned char *src_ptr = state->buf + state->buf_pos;
+	const unsigned char *src_stop = state->buf + stop;
+	const unsigned char *src_end = state->buf + state->buf_len;
+	const unsigned char *compress_src_end = src_end - 4;
+	unsigned char *group = state->group;
+	int32		group_len = state->group_len;
+	unsigned char control_pos = state->control_pos;
+	uint16		hist_next = state->hist_next;
+	uint16		hist_idx = state->hist_idx;
+	uint16		mask = PGLZ_MAX_HISTORY_LISTS - 1;
+	int32		match_len;
+	int32		match_offset;
+
+	if (!state->hist_started && src_ptr < compress_src_end)
+	{
+		hist_idx = pglz_hist_idx(src_ptr, mask);
+		state->hist_started = true;
+	}
+
+	while (src_ptr < src_stop)
+	{
+		/*
+		 * Hand out the control group once all 8 items are in, and open a
+		 * new one.
+		 */
+		if ((control_pos & 0xff) == 0)
+		{
+			memcpy(dest_ptr, group, group_len);
+			dest_ptr += group_len;
+			group[0] = 0;
+			group_len = 1;
+			control_pos = 1;
+		}
+
+		if (src_ptr < compress_src_end &&
+			pglz_find_match(ctx, hist_idx, src_ptr, compress_src_end,
+							&match_len, &match_offset, state->good_match,
+							state->good_drop))
+		{
+			group[0] |= control_pos;
+			group_len = pglz_out_tag(group + group_len, match_len,
+									 match_offset) - group;
+			while (match_len--)
+			{
+				hist_next = pglz_hist_add(ctx, hist_next, &hist_idx, src_ptr,
+										  mask);
+				src_ptr++;
+			}
+		}
+		else
+		{
+			/*
+			 * The last 4 bytes of the stream are neither looked up nor added
+			 * to the history, as in pglz_compress_hacked().
+			 */
+			if (src_ptr < compress_src_end)
+				hist_next = pglz_hist_add(ctx, hist_next, &hist_idx, src_ptr,
+										  mask);
+			group[group_len++] = *src_ptr++;
+		}
+		control_pos <<= 1;
+	}
+
+	if (final && group_len > 0)
+	{
+		memcpy(dest_ptr, group, group_len);
+		dest_ptr += group_len;
+		group_len = 0;
+		control_pos = 0;
+	}
+
+	state->buf_pos = src_ptr - state->buf;
+	state->group_len = group_len;
+	state->control_pos = control_pos;
+	state->hist_next = hist_next;
+	state->hist_idx = hist_idx;
+
+	return (char *) dest_ptr - dest;
+}
+
+
+/* ----------
+ * pglz_stream_slide -
+ *
+ *		Drops the buffered input that has been compressed and is out of
+ *		reach of future tags.  History positions are low address bits, so
+ *		they move along with the data.
+ * ----------
+ */
+static void
+pglz_stream_slide(PGLZ_StreamState *state)
+{
+	int32		shift = state->buf_pos - PGLZ_MAX_OFFSET;
+	int			i;
+
+	if (shift <= 0)
+		return;
+
+	memmove(state->buf, state->buf + shift, state->buf_len - shift);
+	state->buf_len -= shift;
+	state->buf_pos -= shift;
+	for (i = 0; i <= PGLZ_HISTORY_SIZE; i++)
+		state->ctx.hist_pos[i] -= (uint16) shift;
+}
+
+
+/* ----------
+ * pglz_stream_feed -
+ *
+ *		Compresses slen more bytes of the stream.  dest must have room for
+ *		PGLZ_STREAM_MAX_OUTPUT(slen) bytes.  Returns the number of bytes
+ *		written, which may be 0 as the input is buffered until enough of
+ *		it has accumulated.
+ * ----------
+ */
+int32
+pglz_stream_feed(PGLZ_StreamState *state, const char *source, int32 slen,
+				 char *dest)
+{
+	int32		result_size = 0;
+
+	state->raw_size += slen;
+	while (slen > 0)
+	{
+		int32		n = Min(slen, PGLZ_STREAM_BUFFER_SIZE - state->buf_len);
+
+		memcpy(state->buf + state->buf_len, source, n);
+		state->buf_len += n;
+		source += n;
+		slen -= n;
+
+		if (state->buf_len - state->buf_pos > PGLZ_STREAM_LOOKAHEAD)
+			result_size += pglz_stream_compress(state,
+												state->buf_len - PGLZ_STREAM_LOOKAHEAD,
+												false, dest + result_size);
+		if (state->buf_len == PGLZ_STREAM_BUFFER_SIZE)
+			pglz_stream_slide(state);
+	}
+
+	return result_size;
+}
+
+
+/* ----------
+ * pglz_stream_finish -
+ *
+ *		Compresses what is left of the stream.  dest must have room for
+ *		PGLZ_STREAM_MAX_OUTPUT(0) bytes.  Returns the number of bytes
+ *		written.  The rawsize to decompress the stream with is in
+ *		state->raw_size.
+ * ----------
+ */
+int32
+pglz_stream_finish(PGLZ_StreamState *state, char *dest)
+{
+	return pglz_stream_compress(state, state->buf_len, true, dest);
+}
@@ -0,0 +1,323 @@
+/* ----------
+ * pg_lzcompress_hacked_simd.c -
+ *
+ *		Decompressor with a vector match-copy kernel.
+ *
+ *		A match with an offset smaller than 16 is a repeating pattern of
+ *		offset bytes.  Instead of the chain of doubling memcpy() calls the
+ *		kernel loads 16 bytes at dp - off, spreads the first off of them
+ *		over the whole vector with one byte shuffle and stores that vector
+ *		as many times as needed.  Every store advances by the largest
+ *		multiple of off that fits into 16 bytes, so consecutive stores
+ *		continue the pattern.  Matches with larger offsets are copied in
+ *		16 byte chunks.  Both may write up to 16 bytes past the end of the
+ *		match, so they are only used while that much output space is left;
+ *		near the end of the buffer the usual scalar copy is used.
+ *
+ *		The byte shuffle needs SSSE3 on x86, SSE2 has none.  It is chosen
+ *		at runtime by CPUID, and CPUs without it fall back to
+ *		pglz_decompress_hacked().  On AArch64 NEON is always present.
+ *
+ *		Entry routine:
+ *
+ *			int32
+ *			pglz_decompress_hacked_simd(const char *source, int32 slen,
+ *										char *dest, int32 rawsize,
+ *										bool check_complete)
+ *
+ *				Same contract as pglz_decompress().
+ *
+ *			uint32
+ *			pglz_cpu_features(void)
+ *
+ *				The PGLZ_CPU_* features of this CPU, which codecs in the
+ *				registry may require.
+ *
+ * Copyright (c) 1999-2019, PostgreSQL Global Development Group
+ *
+ * contrib/test_pglz/pg_lzcompress_hacked_simd.c
+ * ----------
+ */
+#include "postgres.h"
+
+#include "common/pg_lzcompress.h"
+#include "pg_lzcompress_hacked.h"
+
+#if PGLZ_SIMD_FEATURES == PGLZ_CPU_SSSE3
+#include <cpuid.h>
+#include <tmmintrin.h>
+#define USE_SSSE3_MATCH_COPY
+#define pglz_attribute_simd __attribute__((target("ssse3")))
+#elif PGLZ_SIMD_FEATURES == PGLZ_CPU_NEON
+#include <arm_neon.h>
+#define USE_NEON_MATCH_COPY
+#define pglz_attribute_simd
+#endif
+
+#if defined(USE_SSSE3_MATCH_COPY) || defined(USE_NEON_MATCH_COPY)
+
+/* Output space the vector kernels may use past the end of a match */
+#define PGLZ_SIMD_SLACK			16
+
+/*
+ * pglz_shuffle_masks[off] spreads the first off bytes of a vector over all
+ * 16 bytes.  Offset 0 never occurs in valid input; it maps to a harmless
+ * mask so that corrupt input cannot make the kernel loop forever.
+ */
+static const unsigned char pglz_shuffle_masks[16][16] = {
+	{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+	{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+	{0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1},
+	{0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0},
+	{0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3},
+	{0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0},
+	{0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3},
+	{0, 1, 2, 3, 4, 5, 6, 0, 1, 2, 3, 4, 5, 6, 0, 1},
+	{0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7},
+	{0, 1, 2, 3, 4, 5, 6, 7, 8, 0, 1, 2, 3, 4, 5, 6},
+	{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5},
+	{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 0, 1, 2, 3, 4},
+	{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 0, 1, 2, 3},
+	{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 0, 1, 2},
+	{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 0, 1},
+	{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 0},
+};
+
+/* Largest multiple of off not exceeding 16 */
+static const unsigned char pglz_shuffle_steps[16] = {
+	16, 16, 16, 15, 16, 15, 12, 14, 16, 9, 10, 11, 12, 13, 14, 15
+};
+
+
+/* ----------
+ * pglz_copy_match_simd -
+ *
+ *		Copies a match of len bytes from dp - off to dp.  The caller must
+ *		guarantee PGLZ_SIMD_SLACK bytes of output space after the match.
+ * ----------
+ */
+static inline pglz_attribute_simd unsigned char *
+pglz_copy_match_simd(unsigned char *dp, int32 off, int32 len)
+{
+	unsigned char *end = dp + len;
+
+	if (off < 16)
+	{
+		int32		step = pglz_shuffle_steps[off];
+#ifdef USE_SSSE3_MATCH_COPY
+		__m128i		pattern = _mm_loadu_si128((const __m128i *) (dp - off));
+
+		pattern = _mm_shuffle_epi8(pattern,
+								   _mm_loadu_si128((const __m128i *) pglz_shuffle_masks[off]));
+		do
+		{
+			_mm_storeu_si128((__m128i *) dp, pattern);
+			dp += step;
+		} while (dp < end);
+#else
+		uint8x16_t	pattern = vld1q_u8(dp - off);
+
+		pattern = vqtbl1q_u8(pattern, vld1q_u8(pglz_shuffle_masks[off]));
+		do
+		{
+			vst1q_u8(dp, pattern);
+			dp += step;
+		} while (dp < end);
+#endif
+	}
+	else
+	{
+		do
+		{
+#ifdef USE_SSSE3_MATCH_COPY
+			_mm_storeu_si128((__m128i *) dp,
+							 _mm_loadu_si128((const __m128i *) (dp - off)));
+#else
+			vst1q_u8(dp, vld1q_u8(dp - off));
+#endif
+			dp += 16;
+		} while (dp < end);
+	}
+
+	return end;
+}
+
+
+/* ----------
+ * pglz_decompress_hacked_shuffle -
+ *
+ *		pglz_decompress_hacked() with the vector match-copy kernel.  Only
+ *		to be called if pglz_cpu_features() has PGLZ_SIMD_FEATURES.
+ * ----------
+ */
+pglz_attribute_simd int32
+pglz_decompress_hacked_shuffle(const char *source, int32 slen, char *dest,
+							   int32 rawsize, bool check_complete)
+{
+	const unsigned char *sp;
+	const unsigned char *srcend;
+	unsigned char *dp;
+	unsigned char *destend;
+
+	sp = (const unsigned char *) source;
+	srcend = ((const unsigned char *) source) + slen;
+	dp = (unsigned char *) dest;
+	destend = dp + rawsize;
+
+	while (sp < srcend && dp < destend)
+	{
+		/*
+		 * Read one control byte and process the next 8 items (or as many as
+		 * remain in the compressed input).
+		 */
+		unsigned char ctrl = *sp++;
+		int			ctrlc;
+
+		for (ctrlc = 0; ctrlc < 8 && sp < srcend && dp < destend; ctrlc++)
+		{
+
+			if (ctrl & 1)
+			{
+				/*
+				 * Otherwise it contains the match length minus 3 and the
+				 * upper 4 bits of the offset. The next following byte
+				 * contains the lower 8 bits of the offset. If the length is
+				 * coded as 18, another extension tag byte tells how much
+				 * longer the match really was (0-255).
+				 */
+				int32		len;
+				int32		off;
+
+				len = (sp[0] & 0x0f) + 3;
+				off = ((sp[0] & 0xf0) << 4) | sp[1];
+				sp += 2;
+				if (len == 18)
+					len += *sp++;
+
+				/*
+				 * Use the vector kernel while it cannot write past the end
+				 * of the output.  Otherwise copy the bytes specified by the
+				 * tag from OUTPUT to OUTPUT in growing non-overlapping
+				 * pieces.
+				 */
+				if (destend - dp >= len + PGLZ_SIMD_SLACK)
+				{
+					dp = pglz_copy_match_simd(dp, off, len);
+				}
+				else
+				{
+					len = Min(len, destend - dp);
+					while (off < len)
+					{
+						memcpy(dp, dp - off, off);
+						len -= off;
+						dp += off;
+						off += off;
+					}
+					memcpy(dp, dp - off, len);
+					dp += len;
+				}
+			}
+			else
+			{
+				/*
+				 * An unset control bit means LITERAL BYTE. So we just copy
+				 * one from INPUT to OUTPUT.
+				 */
+				*dp++ = *sp++;
+			}
+
+			/*
+			 * Advance the control bit
+			 */
+			ctrl >>= 1;
+		}
+	}
+
+	/*
+	 * Check we decompressed the right amount.
+	 * If we are slicing, then we won't necessarily
+	 * be at the end of the source or dest buffers
+	 * when we hit a stop, so we don't test them.
+	 */
+	if (check_complete && (dp != destend || sp != srcend))
+		return -1;
+
+	/*
+	 * That's it.
+	 */
+	return (char *) dp - dest;
+}
+
+
+#endif							/* USE_SSSE3_MATCH_COPY || USE_NEON_MATCH_COPY */
+
+
+/* ----------
+ * pglz_cpu_features -
+ *
+ *		Returns the PGLZ_CPU_* features of the CPU we are running on.
+ * ----------
+ */
+uint32
+pglz_cpu_features(void)
+{
+	uint32		features = 0;
+#if defined(USE_SSSE3_MATCH_COPY)
+	unsigned int eax,
+				ebx,
+				ecx,
+				edx;
+
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSSE3) != 0)
+		features |= PGLZ_CPU_SSSE3;
+#elif defined(USE_NEON_MATCH_COPY)
+	features |= PGLZ_CPU_NEON;
+#endif
+
+	return features;
+}
+
+
+static int32 pglz_decompress_hacked_simd_choose(const char *source, int32 slen,
+												char *dest, int32 rawsize,
+												bool check_complete);
+
+static PGLZ_DecompressFunc pglz_decompress_hacked_simd_impl =
+	pglz_decompress_hacked_simd_choose;
+
+
+/*
+ * This gets called on the first call.  It replaces the function pointer so
+ * that subsequent calls are routed directly to the chosen implementation.
+ */
+static int32
+pglz_decompress_hacked_simd_choose(const char *source, int32 slen, char *dest,
+								   int32 rawsize, bool check_complete)
+{
+#if defined(USE_SSSE3_MATCH_COPY) || defined(USE_NEON_MATCH_COPY)
+	if ((pglz_cpu_features() & PGLZ_SIMD_FEATURES) == PGLZ_SIMD_FEATURES)
+		pglz_decompress_hacked_simd_impl = pglz_decompress_hacked_shuffle;
+	else
+#endif
+		pglz_decompress_hacked_simd_impl = pglz_decompress_hacked;
+
+	return pglz_decompress_hacked_simd_impl(source, slen, dest, rawsize,
+											check_complete);
+}
+
+
+/* ----------
+ * pglz_decompress_hacked_simd -
+ *
+ *		Decompresses source into dest with the best match-copy kernel the
+ *		CPU supports.
+ * ----------
+ */
+int32
+pglz_decompress_hacked_simd(const char *source, int32 slen, char *dest,
+							int32 rawsize, bool check_complete)
+{
+	return pglz_decompress_hacked_simd_impl(source, slen, dest, rawsize,
+											check_complete);
+}
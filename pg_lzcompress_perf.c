@@ -0,0 +1,226 @@
+/* ----------
+ * pg_lzcompress_perf.c -
+ *
+ *		Hardware performance counters for the benchmarks.
+ *
+ *		Wall time says how fast a codec is, not why.  These routines count
+ *		cycles, instructions, branch misses and L1D and last level cache
+ *		misses of the calling thread with perf_event_open(), so that the
+ *		benchmarks can report cycles per byte and instructions per cycle.
+ *		The events form one group with the cycles as leader, so that the
+ *		kernel schedules them together; if the PMU still has to multiplex
+ *		them, the counts are scaled by the share of the time they ran.
+ *		Only user space is counted, which perf_event_paranoid 2 allows.
+ *
+ *		Elsewhere than on Linux pglz_perf_open() always fails.
+ *
+ *		Entry routines:
+ *
+ *			bool
+ *			pglz_perf_open(PGLZ_PerfCounters *counters)
+ *
+ *				Opens the counters, stopped and zeroed.  Returns false with
+ *				errno set if not even the cycles can be counted; events
+ *				the CPU lacks are left out.
+ *
+ *			void
+ *			pglz_perf_start(PGLZ_PerfCounters *counters)
+ *			void
+ *			pglz_perf_stop(PGLZ_PerfCounters *counters)
+ *
+ *				Let all counters run and stop them again.
+ *
+ *			void
+ *			pglz_perf_read(PGLZ_PerfCounters *counters,
+ *						   int64 values[PGLZ_PERF_EVENTS])
+ *
+ *				Returns the counts so far, indexed by PGLZ_PerfEvent, -1
+ *				for the events left out.
+ *
+ *			void
+ *			pglz_perf_close(PGLZ_PerfCounters *counters)
+ *
+ *				Closes the counters.
+ *
+ * Copyright (c) 1999-2019, PostgreSQL Global Development Group
+ *
+ * contrib/test_pglz/pg_lzcompress_perf.c
+ * ----------
+ */
+#include "postgres.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "common/pg_lzcompress.h"
+#include "pg_lzcompress_hacked.h"
+
+
+#ifdef __linux__
+
+/* What each PGLZ_PerfEvent stands for */
+static const struct
+{
+	uint32		type;
+	uint64		config;
+}			pglz_perf_events[PGLZ_PERF_EVENTS] =
+{
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+	{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+		(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+	(PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+};
+
+
+/* ----------
+ * pglz_perf_open -
+ *
+ *		Opens the group of counters.
+ * ----------
+ */
+bool
+pglz_perf_open(PGLZ_PerfCounters *counters)
+{
+	int			i;
+
+	for (i = 0; i < PGLZ_PERF_EVENTS; i++)
+		counters->fd[i] = -1;
+
+	for (i = 0; i < PGLZ_PERF_EVENTS; i++)
+	{
+		struct perf_event_attr attr;
+
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = pglz_perf_events[i].type;
+		attr.config = pglz_perf_events[i].config;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+			PERF_FORMAT_TOTAL_TIME_RUNNING;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		/* the leader starts the group, the others follow it */
+		attr.disabled = i == PGLZ_PERF_CYCLES;
+
+		counters->fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1,
+								  i == PGLZ_PERF_CYCLES ? -1 : counters->fd[PGLZ_PERF_CYCLES],
+								  0);
+		if (counters->fd[PGLZ_PERF_CYCLES] < 0)
+			return false;
+	}
+
+	return true;
+}
+
+
+void
+pglz_perf_start(PGLZ_PerfCounters *counters)
+{
+	ioctl(counters->fd[PGLZ_PERF_CYCLES], PERF_EVENT_IOC_ENABLE,
+		  PERF_IOC_FLAG_GROUP);
+}
+
+
+void
+pglz_perf_stop(PGLZ_PerfCounters *counters)
+{
+	ioctl(counters->fd[PGLZ_PERF_CYCLES], PERF_EVENT_IOC_DISABLE,
+		  PERF_IOC_FLAG_GROUP);
+}
+
+
+/* ----------
+ * pglz_perf_read -
+ *
+ *		Reads every counter, scaled up if it did not run all the time the
+ *		group was enabled.
+ * ----------
+ */
+void
+pglz_perf_read(PGLZ_PerfCounters *counters, int64 values[PGLZ_PERF_EVENTS])
+{
+	int			i;
+
+	for (i = 0; i < PGLZ_PERF_EVENTS; i++)
+	{
+		uint64		data[3];	/* value, time enabled, time running */
+
+		values[i] = -1;
+		if (counters->fd[i] < 0 ||
+			read(counters->fd[i], data, sizeof(data)) != sizeof(data))
+			continue;
+
+		if (data[2] == 0)
+			values[i] = 0;
+		else if (data[2] < data[1])
+			values[i] = (int64) ((double) data[0] * data[1] / data[2]);
+		else
+			values[i] = data[0];
+	}
+}
+
+
+void
+pglz_perf_close(PGLZ_PerfCounters *counters)
+{
+	int			i;
+
+	/* the members first, so that the group goes away with its leader */
+	for (i = PGLZ_PERF_EVENTS - 1; i >= 0; i--)
+	{
+		if (counters->fd[i] >= 0)
+			close(counters->fd[i]);
+		counters->fd[i] = -1;
+	}
+}
+
+#else							/* !__linux__ */
+
+bool
+pglz_perf_open(PGLZ_PerfCounters *counters)
+{
+	int			i;
+
+	for (i = 0; i < PGLZ_PERF_EVENTS; i++)
+		counters->fd[i] = -1;
+	errno = ENOSYS;
+	return false;
+}
+
+
+void
+pglz_perf_start(PGLZ_PerfCounters *counters)
+{
+}
+
+
+void
+pglz_perf_stop(PGLZ_PerfCounters *counters)
+{
+}
+
+
+void
+pglz_perf_read(PGLZ_PerfCounters *counters, int64 values[PGLZ_PERF_EVENTS])
+{
+	int			i;
+
+	for (i = 0; i < PGLZ_PERF_EVENTS; i++)
+		values[i] = -1;
+}
+
+
+void
+pglz_perf_close(PGLZ_PerfCounters *counters)
+{
+}
+
+#endif							/* __linux__ */
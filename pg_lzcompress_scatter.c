@@ -0,0 +1,237 @@
+/* ----------
+ * pg_lzcompress_scatter.c -
+ *
+ *		Decompression into a list of caller buffers.
+ *
+ *		The other decompressors need the whole output in one buffer, so a
+ *		value that ends up spread over, say, the free space of several
+ *		pages or the columns of a slot is decompressed into a temporary
+ *		buffer first and then copied to its places.  This decompressor
+ *		writes the output straight into the segments instead, which saves
+ *		the allocation and the copy.
+ *
+ *		Back references may reach into earlier segments.  Those copies are
+ *		done piecewise; copies within one segment, the vast majority when
+ *		segments are large, take the same path as pglz_decompress_hacked().
+ *		Finding the start of a copy needs its offset checked against the
+ *		output so far, so unlike the plain decompressors this one never
+ *		refers to memory before the output.
+ *
+ *		Entry routines:
+ *
+ *			int32
+ *			pglz_decompress_scatter(const char *source, int32 slen,
+ *									const PGLZ_Segment *segments,
+ *									int nsegments, bool check_complete)
+ *
+ *				Decompresses source into the segments in order; the raw
+ *				size is the sum of their lengths, and empty segments are
+ *				allowed.  Returns the number of bytes written, or -1 if
+ *				the stream is corrupt or, with check_complete, does not
+ *				fill all segments exactly.  The segments must not overlap.
+ *
+ * Copyright (c) 1999-2019, PostgreSQL Global Development Group
+ *
+ * contrib/test_pglz/pg_lzcompress_scatter.c
+ * ----------
+ */
+#include "postgres.h"
+
+#include "common/pg_lzcompress.h"
+#include "pg_lzcompress_hacked.h"
+
+
+/* A position in the segments */
+typedef struct PGLZ_ScatterPos
+{
+	int			segment;
+	unsigned char *ptr;
+	unsigned char *end;			/* of the segment */
+} PGLZ_ScatterPos;
+
+
+/* ----------
+ * pglz_scatter_next -
+ *
+ *		Moves pos to the start of the next segment that is not empty.
+ *		Returns false if there is none.
+ * ----------
+ */
+static inline bool
+pglz_scatter_next(PGLZ_ScatterPos *pos, const PGLZ_Segment *segments,
+				  int nsegments)
+{
+	while (pos->ptr == pos->end)
+	{
+		if (pos->segment + 1 >= nsegments)
+			return false;
+		pos->segment++;
+		pos->ptr = (unsigned char *) segments[pos->segment].data;
+		pos->end = pos->ptr + segments[pos->segment].len;
+	}
+	return true;
+}
+
+
+/* ----------
+ * pglz_scatter_back -
+ *
+ *		Returns the position off bytes before dp, which must not be before
+ *		the start of the output.
+ * ----------
+ */
+static PGLZ_ScatterPos
+pglz_scatter_back(const PGLZ_ScatterPos *dp, const PGLZ_Segment *segments,
+				  int32 off)
+{
+	PGLZ_ScatterPos pos;
+	int32		need = off - (int32) (dp->ptr - (unsigned char *) segments[dp->segment].data);
+
+	pos.segment = dp->segment;
+	while (need > 0)
+	{
+		pos.segment--;
+		if (need <= segments[pos.segment].len)
+			break;
+		need -= segments[pos.segment].len;
+	}
+	if (pos.segment == dp->segment)
+		pos.ptr = dp->ptr - off;
+	else
+		pos.ptr = (unsigned char *) segments[pos.segment].data +
+			segments[pos.segment].len - need;
+	pos.end = (unsigned char *) segments[pos.segment].data +
+		segments[pos.segment].len;
+
+	return pos;
+}
+
+
+/* ----------
+ * pglz_decompress_scatter -
+ *
+ *		Decompresses a pglz stream into a list of segments.
+ * ----------
+ */
+int32
+pglz_decompress_scatter(const char *source, int32 slen,
+						const PGLZ_Segment *segments, int nsegments,
+						bool check_complete)
+{
+	const unsigned char *sp = (const unsigned char *) source;
+	const unsigned char *srcend = sp + slen;
+	PGLZ_ScatterPos dp;
+	int32		rawsize = 0;
+	int32		written = 0;
+	int			i;
+
+	for (i = 0; i < nsegments; i++)
+	{
+		if (segments[i].len < 0 || segments[i].len > PG_INT32_MAX - rawsize)
+			return -1;
+		rawsize += segments[i].len;
+	}
+	if (nsegments == 0)
+		return check_complete && slen != 0 ? -1 : 0;
+
+	dp.segment = 0;
+	dp.ptr = (unsigned char *) segments[0].data;
+	dp.end = dp.ptr + segments[0].len;
+
+	while (sp < srcend && written < rawsize)
+	{
+		/*
+		 * Read one control byte and process the next 8 items (or as many as
+		 * remain in the compressed input).
+		 */
+		unsigned char ctrl = *sp++;
+		int			ctrlc;
+
+		for (ctrlc = 0; ctrlc < 8 && sp < srcend && written < rawsize; ctrlc++)
+		{
+			/* there is output left, so a segment with room follows */
+			pglz_scatter_next(&dp, segments, nsegments);
+
+			if (ctrl & 1)
+			{
+				int32		len;
+				int32		off;
+
+				if (srcend - sp < 2)
+					return -1;
+				len = (sp[0] & 0x0f) + 3;
+				off = ((sp[0] & 0xf0) << 4) | sp[1];
+				sp += 2;
+				if (len == 18)
+				{
+					if (sp >= srcend)
+						return -1;
+					len += *sp++;
+				}
+				if (off == 0 || off > written)
+					return -1;
+				len = Min(len, rawsize - written);
+				written += len;
+
+				if (dp.end - dp.ptr >= len &&
+					dp.ptr - (unsigned char *) segments[dp.segment].data >= off)
+				{
+					/* within the segment, as in pglz_decompress_hacked() */
+					while (off < len)
+					{
+						memcpy(dp.ptr, dp.ptr - off, off);
+						len -= off;
+						dp.ptr += off;
+						off += off;
+					}
+					memcpy(dp.ptr, dp.ptr - off, len);
+					dp.ptr += len;
+				}
+				else
+				{
+					PGLZ_ScatterPos from = pglz_scatter_back(&dp, segments, off);
+
+					/*
+					 * Piecewise over segment boundaries.  No piece is longer
+					 * than off, so that it never overlaps its own source.
+					 */
+					while (len > 0)
+					{
+						int32		n = Min(len, off);
+
+						pglz_scatter_next(&dp, segments, nsegments);
+						pglz_scatter_next(&from, segments, nsegments);
+						n = Min(n, dp.end - dp.ptr);
+						n = Min(n, from.end - from.ptr);
+						memcpy(dp.ptr, from.ptr, n);
+						dp.ptr += n;
+						from.ptr += n;
+						len -= n;
+					}
+				}
+			}
+			else
+			{
+				/*
+				 * An unset control bit means LITERAL BYTE. So we just copy
+				 * one from INPUT to OUTPUT.
+				 */
+				*dp.ptr++ = *sp++;
+				written++;
+			}
+
+			/*
+			 * Advance the control bit
+			 */
+			ctrl >>= 1;
+		}
+	}
+
+	/*
+	 * Check we decompressed the right amount.
+	 */
+	if (check_complete && (written != rawsize || sp != srcend))
+		return -1;
+
+	return written;
+}
@@ -0,0 +1,107 @@
+/* ----------
+ * pg_lzcompress_stats.c -
+ *
+ *		Counters of the hacked compressor and decompressor internals.
+ *
+ *		Built with -DPGLZ_STATS, pglz_compress_hacked() and
+ *		pglz_decompress_hacked() count their literals, matches and copies,
+ *		and pglz_find_match() the history entries it walks, in the
+ *		pglz_stats of the thread they run in.  test_pglz_stats() reports
+ *		them.  Without the flag this file is empty and the counting macros
+ *		cost nothing.
+ *
+ *		Entry routines:
+ *
+ *			void
+ *			pglz_stats_reset(void)
+ *
+ *				Zeroes the counters of the calling thread and the total.
+ *
+ *			void
+ *			pglz_stats_flush(void)
+ *
+ *				Adds the counters of the calling thread to the total and
+ *				zeroes them.  The helpers of the batch routines call this
+ *				when they are done with a batch.
+ *
+ *			void
+ *			pglz_stats_collect(PGLZ_Stats *stats)
+ *
+ *				Flushes the calling thread and copies the total to stats.
+ *
+ * Copyright (c) 1999-2019, PostgreSQL Global Development Group
+ *
+ * contrib/test_pglz/pg_lzcompress_stats.c
+ * ----------
+ */
+#include "postgres.h"
+
+#include <pthread.h>
+
+#include "common/pg_lzcompress.h"
+#include "pg_lzcompress_hacked.h"
+
+#ifdef PGLZ_STATS
+
+__thread PGLZ_Stats pglz_stats;
+
+/* What the threads have flushed, protected by stats_lock */
+static PGLZ_Stats stats_total;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* ----------
+ * pglz_stats_reset -
+ *
+ *		Zeroes the counters of the calling thread and the total.
+ * ----------
+ */
+void
+pglz_stats_reset(void)
+{
+	memset(&pglz_stats, 0, sizeof(pglz_stats));
+	pthread_mutex_lock(&stats_lock);
+	memset(&stats_total, 0, sizeof(stats_total));
+	pthread_mutex_unlock(&stats_lock);
+}
+
+
+/* ----------
+ * pglz_stats_flush -
+ *
+ *		Moves the counters of the calling thread into the total.  All
+ *		fields of PGLZ_Stats must be int64: the struct is added up as an
+ *		array of them.
+ * ----------
+ */
+void
+pglz_stats_flush(void)
+{
+	int64	   *from = (int64 *) &pglz_stats;
+	int64	   *to = (int64 *) &stats_total;
+	size_t		i;
+
+	pthread_mutex_lock(&stats_lock);
+	for (i = 0; i < sizeof(PGLZ_Stats) / sizeof(int64); i++)
+		to[i] += from[i];
+	pthread_mutex_unlock(&stats_lock);
+	memset(&pglz_stats, 0, sizeof(pglz_stats));
+}
+
+
+/* ----------
+ * pglz_stats_collect -
+ *
+ *		Returns the counts of all threads since the last reset.
+ * ----------
+ */
+void
+pglz_stats_collect(PGLZ_Stats *stats)
+{
+	pglz_stats_flush();
+	pthread_mutex_lock(&stats_lock);
+	*stats = stats_total;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+#endif							/* PGLZ_STATS */
@@ -0,0 +1,318 @@
+/* ----------
+ * pg_lzcompress_verify.c -
+ *
+ *		Cross-checks of the registered codecs against the vanilla ones.
+ *
+ *		A fast kernel that produces wrong output must not be able to look
+ *		like a win, so every routine here compares byte for byte with
+ *		pglz_compress_vanilla() or pglz_decompress_vanilla() and checks
+ *		that nothing is written outside the space the caller provides.
+ *		They all return NULL if the codec passes and otherwise a static
+ *		string saying what went wrong.
+ *
+ *		Entry routines:
+ *
+ *			const char *
+ *			pglz_verify_compress(const PGLZ_Codec *compressor,
+ *								 const char *source, int32 slen,
+ *								 char *dest, int32 *clen)
+ *
+ *				Compresses source into dest, which must have room for
+ *				PGLZ_VERIFY_COMPRESS_SPACE(slen) bytes, and checks that
+ *				pglz_decompress_vanilla() restores source from the result.
+ *				*clen is the compressed size, or -1 if the compressor gave
+ *				up, which is not an error.
+ *
+ *			const char *
+ *			pglz_verify_decompress(const PGLZ_Codec *decompressor,
+ *								   const char *compressed, int32 clen,
+ *								   const char *source, int32 slen)
+ *
+ *				Checks that decompressor restores source from a valid
+ *				stream, both completely and when asked for a prefix only.
+ *
+ *			const char *
+ *			pglz_verify_stream(const PGLZ_Codec *decompressor,
+ *							   const char *stream, int32 slen,
+ *							   int32 rawsize, bool check_complete)
+ *
+ *				Feeds arbitrary, possibly malformed, bytes to decompressor
+ *				and checks that it returns and writes what
+ *				pglz_decompress_vanilla() does.
+ *
+ *		The routines use malloc and never elog, so that the fuzz target
+ *		can use them outside of a backend.
+ *
+ * Copyright (c) 1999-2019, PostgreSQL Global Development Group
+ *
+ * contrib/test_pglz/pg_lzcompress_verify.c
+ * ----------
+ */
+#include "postgres.h"
+
+#include "common/pg_lzcompress.h"
+#include "pg_lzcompress_hacked.h"
+
+
+#define PGLZ_VERIFY_CANARY_BYTE	0xA5
+
+/*
+ * Unchecked decoders follow offsets up to PGLZ_MAX_OFFSET bytes before
+ * dest, and a tag cut off at the end of the input makes them read up to
+ * PGLZ_VERIFY_SOURCE_SLACK bytes past it.  For malformed input both areas
+ * are provided and filled the same way for every decoder, so that they
+ * produce comparable output instead of crashing.
+ */
+#define PGLZ_VERIFY_GUARD		PGLZ_MAX_OFFSET
+#define PGLZ_VERIFY_SOURCE_SLACK 2
+
+
+/* ----------
+ * pglz_canary_intact -
+ *
+ *		Have the PGLZ_VERIFY_CANARY bytes at p kept their canary value?
+ * ----------
+ */
+static bool
+pglz_canary_intact(const char *p)
+{
+	int			i;
+
+	for (i = 0; i < PGLZ_VERIFY_CANARY; i++)
+		if ((unsigned char) p[i] != PGLZ_VERIFY_CANARY_BYTE)
+			return false;
+	return true;
+}
+
+
+/* ----------
+ * pglz_verify_compress -
+ *
+ *		Checks one compression of source with compressor.
+ * ----------
+ */
+const char *
+pglz_verify_compress(const PGLZ_Codec *compressor, const char *source,
+					 int32 slen, char *dest, int32 *clen)
+{
+	const char *failure = NULL;
+	char	   *output;
+	int32		result;
+
+	memset(dest + PGLZ_MAX_OUTPUT(slen), PGLZ_VERIFY_CANARY_BYTE,
+		   PGLZ_VERIFY_CANARY);
+	*clen = compressor->compress(source, slen, dest, PGLZ_strategy_always);
+
+	if (!pglz_canary_intact(dest + PGLZ_MAX_OUTPUT(slen)))
+		return "compressor wrote past PGLZ_MAX_OUTPUT";
+	if (*clen < -1 || *clen > PGLZ_MAX_OUTPUT(slen))
+		return "compressor returned an impossible size";
+	if (*clen == -1)
+		return NULL;
+
+	output = malloc(Max(slen, 1));
+	if (output == NULL)
+		return "out of memory";
+	result = pglz_decompress_vanilla(dest, *clen, output, slen, true);
+	if (result != slen || memcmp(output, source, slen) != 0)
+		failure = "pglz_decompress_vanilla does not restore the input";
+	free(output);
+
+	return failure;
+}
+
+
+/* ----------
+ * pglz_verify_decode -
+ *
+ *		Decompresses rawsize bytes of a valid stream and compares them with
+ *		expected.  output has room for rawsize + dest_slack bytes and the
+ *		canary after them.
+ * ----------
+ */
+static const char *
+pglz_verify_decode(const PGLZ_Codec *decompressor, const char *compressed,
+				   int32 clen, const char *expected, int32 rawsize,
+				   bool check_complete, char *output)
+{
+	int32		result;
+
+	memset(output + rawsize + decompressor->dest_slack,
+		   PGLZ_VERIFY_CANARY_BYTE, PGLZ_VERIFY_CANARY);
+	result = decompressor->decompress(compressed, clen, output, rawsize,
+									  check_complete);
+
+	if (!pglz_canary_intact(output + rawsize + decompressor->dest_slack))
+		return "decompressor wrote past rawsize and its slack";
+	if (result != rawsize)
+		return "decompressor returned a wrong size";
+	if (memcmp(output, expected, rawsize) != 0)
+		return "decompressor produced different data";
+	return NULL;
+}
+
+
+/* ----------
+ * pglz_verify_decompress -
+ *
+ *		Checks decompressor on a valid stream of source.
+ * ----------
+ */
+const char *
+pglz_verify_decompress(const PGLZ_Codec *decompressor, const char *compressed,
+					   int32 clen, const char *source, int32 slen)
+{
+	const char *failure;
+	char	   *output;
+
+	output = malloc(slen + decompressor->dest_slack + PGLZ_VERIFY_CANARY);
+	if (output == NULL)
+		return "out of memory";
+
+	failure = pglz_verify_decode(decompressor, compressed, clen, source, slen,
+								 true, output);
+
+	/* a slice of the value, as for PGLZ-compressed TOAST slices */
+	if (failure == NULL)
+		failure = pglz_verify_decode(decompressor, compressed, clen, source,
+									 slen / 2, false, output);
+
+	free(output);
+
+	return failure;
+}
+
+
+/* ----------
+ * pglz_has_zero_offset -
+ *
+ *		Does decoding stream into rawsize bytes meet a tag with offset 0?
+ *		The unchecked decoders copy such a match in pieces that never grow,
+ *		so they do not terminate on it.
+ * ----------
+ */
+static bool
+pglz_has_zero_offset(const unsigned char *sp, int32 slen, int32 rawsize)
+{
+	const unsigned char *srcend = sp + slen;
+	int32		produced = 0;
+
+	while (sp < srcend && produced < rawsize)
+	{
+		unsigned char ctrl = *sp++;
+		int			ctrlc;
+
+		for (ctrlc = 0; ctrlc < 8 && sp < srcend && produced < rawsize; ctrlc++)
+		{
+			if (ctrl & 1)
+			{
+				int32		len = (sp[0] & 0x0f) + 3;
+
+				if (((sp[0] & 0xf0) << 4 | sp[1]) == 0)
+					return true;
+				sp += 2;
+				if (len == 18)
+					len += *sp++;
+				produced += Min(len, rawsize - produced);
+			}
+			else
+			{
+				sp++;
+				produced++;
+			}
+			ctrl >>= 1;
+		}
+	}
+
+	return false;
+}
+
+
+/* ----------
+ * pglz_verify_run -
+ *
+ *		Runs a decoder on malformed input inside the guard areas.  buf has
+ *		room for the guard, rawsize + slack bytes and the canary.
+ * ----------
+ */
+static int32
+pglz_verify_run(PGLZ_DecompressFunc decompress, const char *stream,
+				int32 slen, char *buf, int32 rawsize, int32 slack,
+				bool check_complete)
+{
+	int			i;
+
+	for (i = 0; i < PGLZ_VERIFY_GUARD; i++)
+		buf[i] = (char) i;
+	memset(buf + PGLZ_VERIFY_GUARD, 0, rawsize + slack);
+	memset(buf + PGLZ_VERIFY_GUARD + rawsize + slack,
+		   PGLZ_VERIFY_CANARY_BYTE, PGLZ_VERIFY_CANARY);
+
+	return decompress(stream, slen, buf + PGLZ_VERIFY_GUARD, rawsize,
+					  check_complete);
+}
+
+
+/* ----------
+ * pglz_verify_stream -
+ *
+ *		Checks decompressor against pglz_decompress_vanilla() on arbitrary
+ *		input.  Inputs with zero offsets are skipped for decompressors that
+ *		are not safe_for_untrusted.
+ * ----------
+ */
+const char *
+pglz_verify_stream(const PGLZ_Codec *decompressor, const char *stream,
+				   int32 slen, int32 rawsize, bool check_complete)
+{
+	const char *failure = NULL;
+	int32		bufsize = PGLZ_VERIFY_GUARD + rawsize +
+		decompressor->dest_slack + PGLZ_VERIFY_CANARY;
+	char	   *source;
+	char	   *expected;
+	char	   *output;
+	int32		expected_result;
+	int32		result;
+
+	source = malloc(slen + PGLZ_VERIFY_SOURCE_SLACK);
+	expected = malloc(bufsize);
+	output = malloc(bufsize);
+	if (source == NULL || expected == NULL || output == NULL)
+	{
+		failure = "out of memory";
+		goto done;
+	}
+	memcpy(source, stream, slen);
+	memset(source + slen, 0, PGLZ_VERIFY_SOURCE_SLACK);
+
+	/* the padding is part of what the decoders see */
+	if (!decompressor->safe_for_untrusted &&
+		pglz_has_zero_offset((const unsigned char *) source, slen, rawsize))
+		goto done;
+
+	expected_result = pglz_verify_run(pglz_decompress_vanilla, source, slen,
+									  expected, rawsize,
+									  decompressor->dest_slack,
+									  check_complete);
+	result = pglz_verify_run(decompressor->decompress, source, slen,
+							 output, rawsize, decompressor->dest_slack,
+							 check_complete);
+
+	if (memcmp(output, expected, PGLZ_VERIFY_GUARD) != 0)
+		failure = "decompressor wrote before dest";
+	else if (!pglz_canary_intact(output + bufsize - PGLZ_VERIFY_CANARY))
+		failure = "decompressor wrote past rawsize and its slack";
+	else if (result != expected_result)
+		failure = "decompressor returned a different size";
+	else if (result > 0 &&
+			 memcmp(output + PGLZ_VERIFY_GUARD,
+					expected + PGLZ_VERIFY_GUARD, result) != 0)
+		failure = "decompressor produced different data";
+
+done:
+	free(source);
+	free(expected);
+	free(output);
+
+	return failure;
+}
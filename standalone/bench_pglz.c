@@ -0,0 +1,863 @@
+/* ----------
+ * bench_pglz.c -
+ *
+ *		The test_pglz() benchmark matrix as a standalone program.
+ *
+ *		test_pglz() runs inside a backend, which takes an initdb and a
+ *		server start per run and adds palloc, elog and whatever else the
+ *		backend does to the numbers.  This program links the codec modules
+ *		against the stand-in headers of this directory and runs the same
+ *		payloads, codecs and slice sizes from the command line, one tab
+ *		separated row per payload, codec, direction and slice size, with
+ *		the columns of test_pglz() up to the standard deviation.  It can
+ *		run under perf record, and -C pins it to a CPU for steadier
+ *		numbers.
+ *
+ *		With -t the codecs run on that many threads at once instead, to
+ *		model concurrent backends competing for caches and memory
+ *		bandwidth.  Each thread works on a disjoint range of the slices,
+ *		and the rows give the aggregate GB/s of raw data and percentiles
+ *		of the time each thread took per slice.  -C then pins thread k to
+ *		CPU cpu + k.  Compressors need their compress_ctx for that, so
+ *		pglz_compress_vanilla is left out; slice size 0 is skipped.
+ *
+ *		As in test_pglz(), decompressors are fed by pglz_compress_vanilla()
+ *		and report its ratio, and every result is checked against the
+ *		payload.  Slice size 0 stands for the whole payload.
+ *
+ *		Built by "make -C standalone", run as
+ *
+ *			standalone/bench_pglz [-d dir] [-c codec]... [-p payload]...
+ *								  [-s slice_size]... [-i iterations]
+ *								  [-w warmup] [-C cpu] [-t threads]...
+ *
+ *		The payload files are read from dir, the current directory by
+ *		default; -p also takes the categories corpus and adversary.
+ *
+ * Copyright (c) 1999-2019, PostgreSQL Global Development Group
+ *
+ * contrib/test_pglz/standalone/bench_pglz.c
+ * ----------
+ */
+#ifdef __linux__
+#define _GNU_SOURCE				/* for sched_setaffinity() */
+#include <sched.h>
+#endif
+
+#include "postgres.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "common/pg_lzcompress.h"
+#include "pg_lzcompress_hacked.h"
+#include "portability/instr_time.h"
+
+
+/* the payload files of test_pglz(), followed by pglz_adversaries[] */
+static const char *const bench_payload_files[] =
+{
+	"000000010000000000000001",
+	"000000010000000000000006",
+	"000000010000000000000008",
+	"16398",
+	"shakespeare.txt",
+	"mr", "dickens", "mozilla", "nci", "ooffice", "osdb", "reymont", "samba",
+	"sao", "webster", "x-ray", "xml"
+};
+
+#define BENCH_PAYLOAD_FILES		lengthof(bench_payload_files)
+#define BENCH_PAYLOADS			(BENCH_PAYLOAD_FILES + pglz_adversaries_count)
+#define BENCH_MAX_SLICE_SIZES	64
+#define BENCH_MAX_THREAD_COUNTS	64
+#define BENCH_MAX_THREADS		1024
+
+/* Distribution of the per-iteration results of one benchmark */
+typedef struct BenchStats
+{
+	double		min;
+	double		median;
+	double		p99;
+	double		stddev;
+} BenchStats;
+
+/* One payload cut into slices */
+typedef struct BenchSlices
+{
+	const char *data;
+	int64		size;			/* of the payload */
+	int32		slice_size;
+	int64		nslices;		/* the tail that is no whole slice is left out */
+	int32		stride;			/* between compressed slices */
+	char	   *compressed;
+	int32	   *clen;			/* -1 for slices that did not compress */
+	char	   *output;
+	const PGLZ_Strategy *strategy;	/* see bench_payload_strategy() */
+} BenchSlices;
+
+/* One thread of a throughput benchmark */
+typedef struct BenchThread
+{
+	pthread_t	thread;
+	int			id;
+	BenchSlices *slices;
+	const PGLZ_Codec *codec;
+	pthread_barrier_t *barrier;	/* passed after the warmup runs */
+	int64		first;			/* the thread's slices */
+	int64		count;
+	PGLZ_CompressContext *ctx;	/* for compressors */
+	char	   *output;			/* for decompressors */
+	double	   *latencies;		/* ns per slice of the timed runs */
+} BenchThread;
+
+static const char *bench_dir = ".";
+static int	bench_iterations = 5;
+static int	bench_warmup = 1;
+static int	bench_cpu = -1;		/* not pinned */
+
+
+static void
+bench_usage(const char *progname)
+{
+	fprintf(stderr,
+			"usage: %s [-d dir] [-c codec]... [-p payload]... [-s slice_size]...\n"
+			"       [-i iterations] [-w warmup] [-C cpu] [-t threads]...\n",
+			progname);
+	exit(2);
+}
+
+
+static void
+bench_fail(const char *fmt, const char *arg)
+{
+	fprintf(stderr, "bench_pglz: ");
+	fprintf(stderr, fmt, arg);
+	fputc('\n', stderr);
+	exit(1);
+}
+
+
+static void *
+bench_malloc(size_t size)
+{
+	void	   *p = malloc(size > 0 ? size : 1);
+
+	if (p == NULL)
+		bench_fail("out of memory%s", "");
+	return p;
+}
+
+
+static const char *
+bench_payload_name(int payload)
+{
+	if (payload < (int) BENCH_PAYLOAD_FILES)
+		return bench_payload_files[payload];
+	return pglz_adversaries[payload - BENCH_PAYLOAD_FILES].name;
+}
+
+
+/* ----------
+ * bench_load_payload -
+ *
+ *		Reads a payload file or generates an adversary.
+ * ----------
+ */
+static char *
+bench_load_payload(int payload, int64 *size)
+{
+	char		path[1024];
+	FILE	   *f;
+	char	   *data;
+	long		len;
+
+	if (payload >= (int) BENCH_PAYLOAD_FILES)
+	{
+		data = bench_malloc(PGLZ_ADVERSARY_SIZE);
+		pglz_adversaries[payload - BENCH_PAYLOAD_FILES].generate((unsigned char *) data,
+																 PGLZ_ADVERSARY_SIZE);
+		*size = PGLZ_ADVERSARY_SIZE;
+		return data;
+	}
+
+	snprintf(path, sizeof(path), "%s/%s", bench_dir, bench_payload_files[payload]);
+	f = fopen(path, "rb");
+	if (f == NULL)
+		bench_fail("could not open payload \"%s\"", path);
+	if (fseek(f, 0, SEEK_END) != 0 || (len = ftell(f)) <= 0 ||
+		fseek(f, 0, SEEK_SET) != 0)
+		bench_fail("could not read payload \"%s\"", path);
+	data = bench_malloc(len);
+	if (fread(data, 1, len, f) != (size_t) len)
+		bench_fail("could not read payload \"%s\"", path);
+	fclose(f);
+
+	*size = len;
+	return data;
+}
+
+
+/* ----------
+ * bench_compress_slices -
+ *
+ *		Compresses every slice with compressor and returns the time taken.
+ * ----------
+ */
+static double
+bench_compress_slices(BenchSlices *slices, const PGLZ_Codec *compressor)
+{
+	instr_time	begin;
+	instr_time	end;
+	int64		i;
+
+	INSTR_TIME_SET_CURRENT(begin);
+	for (i = 0; i < slices->nslices; i++)
+		slices->clen[i] = compressor->compress(slices->data + i * slices->slice_size,
+											   slices->slice_size,
+											   slices->compressed + i * slices->stride,
+											   slices->strategy);
+	INSTR_TIME_SET_CURRENT(end);
+	INSTR_TIME_SUBTRACT(end, begin);
+
+	return INSTR_TIME_GET_DOUBLE(end);
+}
+
+
+/* ----------
+ * bench_decompress_slices -
+ *
+ *		Decompresses every slice that compressed with decompressor, and
+ *		returns the time taken.  The output of each slice goes to its
+ *		place in slices->output; the dest slack of a decompressor only
+ *		overwrites the start of the next slice, which is written after.
+ * ----------
+ */
+static double
+bench_decompress_slices(BenchSlices *slices, const PGLZ_Codec *decompressor)
+{
+	instr_time	begin;
+	instr_time	end;
+	int64		i;
+
+	INSTR_TIME_SET_CURRENT(begin);
+	for (i = 0; i < slices->nslices; i++)
+	{
+		int32		result;
+
+		if (slices->clen[i] == -1)
+			continue;
+		result = decompressor->decompress(slices->compressed + i * slices->stride,
+										  slices->clen[i],
+										  slices->output + i * slices->slice_size,
+										  slices->slice_size, true);
+		if (result != slices->slice_size)
+			bench_fail("%s decompressed the wrong size", decompressor->name);
+	}
+	INSTR_TIME_SET_CURRENT(end);
+	INSTR_TIME_SUBTRACT(end, begin);
+
+	return INSTR_TIME_GET_DOUBLE(end);
+}
+
+
+/* ----------
+ * bench_check_slices -
+ *
+ *		Checks the output of the slices that compressed, and returns the
+ *		compressed size over the payload size, with the others counted as
+ *		stored raw.
+ * ----------
+ */
+static double
+bench_check_slices(BenchSlices *slices, const char *codec_name)
+{
+	int64		total = 0;
+	int64		i;
+
+	for (i = 0; i < slices->nslices; i++)
+	{
+		if (slices->clen[i] == -1)
+		{
+			total += slices->slice_size;
+			continue;
+		}
+		if (memcmp(slices->output + i * slices->slice_size,
+				   slices->data + i * slices->slice_size, slices->slice_size) != 0)
+			bench_fail("%s got the data wrong", codec_name);
+		total += slices->clen[i];
+	}
+
+	return total / (double) (slices->nslices * slices->slice_size);
+}
+
+
+static int
+bench_compare_doubles(const void *a, const void *b)
+{
+	double		x = *(const double *) a;
+	double		y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+
+/* ----------
+ * bench_run -
+ *
+ *		Runs one codec warmup times untimed and then iterations times,
+ *		and summarizes the ns per byte of payload.
+ * ----------
+ */
+static void
+bench_run(BenchSlices *slices, const PGLZ_Codec *codec, BenchStats *stats)
+{
+	double	   *samples = bench_malloc(bench_iterations * sizeof(double));
+	double		bytes = (double) slices->size;
+	double		sum = 0;
+	double		squares = 0;
+	double		mean;
+	int			i;
+
+	for (i = 0; i < bench_warmup + bench_iterations; i++)
+	{
+		double		seconds;
+
+		if (codec->compress)
+			seconds = bench_compress_slices(slices, codec);
+		else
+			seconds = bench_decompress_slices(slices, codec);
+		if (i >= bench_warmup)
+			samples[i - bench_warmup] = seconds * 1000000000.0 / bytes;
+	}
+
+	qsort(samples, bench_iterations, sizeof(double), bench_compare_doubles);
+	for (i = 0; i < bench_iterations; i++)
+		sum += samples[i];
+	mean = sum / bench_iterations;
+	for (i = 0; i < bench_iterations; i++)
+		squares += (samples[i] - mean) * (samples[i] - mean);
+	stats->stddev = bench_iterations > 1 ? sqrt(squares / (bench_iterations - 1)) : 0;
+	stats->min = samples[0];
+	stats->median = bench_iterations % 2 ? samples[bench_iterations / 2] :
+		(samples[bench_iterations / 2 - 1] + samples[bench_iterations / 2]) / 2;
+	/* nearest rank */
+	stats->p99 = samples[(int) ceil(bench_iterations * 0.99) - 1];
+
+	free(samples);
+}
+
+
+static void
+bench_print(int payload, const char *codec, const char *direction,
+			int32 slice_size, const BenchStats *stats, double ratio)
+{
+	printf("%s\t%s\t%s\t%d\t%f\t%f\t%f\t%f\t%f\t%f\n",
+		   bench_payload_name(payload), codec, direction, slice_size,
+		   stats->median, 1000.0 / stats->median, ratio,
+		   stats->min, stats->p99, stats->stddev);
+	fflush(stdout);
+}
+
+
+/* ----------
+ * bench_payload_strategy -
+ *
+ *		The adversaries are compressed with PGLZ_strategy_always, which
+ *		turns off the early rejection of input that looks incompressible,
+ *		so that their worst case is timed rather than the early exit.
+ * ----------
+ */
+static const PGLZ_Strategy *
+bench_payload_strategy(int payload)
+{
+	if (payload < (int) BENCH_PAYLOAD_FILES)
+		return PGLZ_strategy_default;
+	return PGLZ_strategy_always;
+}
+
+
+/* ----------
+ * bench_payload -
+ *
+ *		Benchmarks the selected codecs on one payload cut into slices of
+ *		slice_size, 0 for the whole payload.
+ * ----------
+ */
+static void
+bench_payload(int payload, const char *data, int64 size, int32 slice_size,
+			  const bool *use_compressor, const bool *use_decompressor)
+{
+	BenchSlices slices;
+	BenchStats	stats;
+	double		vanilla_ratio;
+	int32		max_slack = 0;
+	int			i;
+
+	slices.data = data;
+	slices.size = size;
+	slices.strategy = bench_payload_strategy(payload);
+	slices.slice_size = slice_size == 0 ? (int32) size : slice_size;
+	slices.nslices = size / slices.slice_size;
+	slices.stride = PGLZ_MAX_OUTPUT(slices.slice_size);
+	for (i = 0; i < pglz_decompressors_count; i++)
+		max_slack = Max(max_slack, pglz_decompressors[i].dest_slack);
+	slices.compressed = bench_malloc((size_t) slices.stride * slices.nslices);
+	slices.clen = bench_malloc(slices.nslices * sizeof(int32));
+	slices.output = bench_malloc((size_t) slices.slice_size * slices.nslices + max_slack);
+
+	/* the decompressors all get the output of pglz_compress_vanilla */
+	bench_compress_slices(&slices, &pglz_compressors[0]);
+	bench_decompress_slices(&slices, &pglz_decompressors[0]);
+	vanilla_ratio = bench_check_slices(&slices, pglz_compressors[0].name);
+
+	for (i = 0; i < pglz_decompressors_count; i++)
+	{
+		if (!use_decompressor[i])
+			continue;
+		bench_run(&slices, &pglz_decompressors[i], &stats);
+		bench_check_slices(&slices, pglz_decompressors[i].name);
+		bench_print(payload, pglz_decompressors[i].name, "decompression",
+					slice_size, &stats, vanilla_ratio);
+	}
+
+	for (i = 0; i < pglz_compressors_count; i++)
+	{
+		double		ratio;
+
+		if (!use_compressor[i])
+			continue;
+		bench_run(&slices, &pglz_compressors[i], &stats);
+		bench_decompress_slices(&slices, &pglz_decompressors[0]);
+		ratio = bench_check_slices(&slices, pglz_compressors[i].name);
+		bench_print(payload, pglz_compressors[i].name, "compression",
+					slice_size, &stats, ratio);
+	}
+
+	free(slices.compressed);
+	free(slices.clen);
+	free(slices.output);
+}
+
+
+/* Pins the calling thread to a CPU */
+static void
+bench_pin_cpu(int cpu)
+{
+	char		arg[16];
+
+	snprintf(arg, sizeof(arg), "%d", cpu);
+#ifdef __linux__
+	{
+		cpu_set_t	set;
+
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set) != 0)
+			bench_fail("could not pin to CPU %s", arg);
+	}
+#else
+	bench_fail("pinning to CPU %s is not supported here", arg);
+#endif
+}
+
+
+/* ----------
+ * bench_thread_main -
+ *
+ *		Runs the codec of a throughput benchmark over the thread's slices,
+ *		warmup times untimed, then after the barrier iterations times,
+ *		each slice timed on its own.
+ * ----------
+ */
+static void *
+bench_thread_main(void *arg)
+{
+	BenchThread *thread = arg;
+	BenchSlices *slices = thread->slices;
+	int			i;
+
+	if (bench_cpu >= 0)
+		bench_pin_cpu(bench_cpu + thread->id);
+
+	for (i = 0; i < bench_warmup + bench_iterations; i++)
+	{
+		int64		j;
+
+		if (i == bench_warmup)
+			pthread_barrier_wait(thread->barrier);
+
+		for (j = 0; j < thread->count; j++)
+		{
+			int64		slice = thread->first + j;
+			instr_time	begin;
+			instr_time	end;
+
+			INSTR_TIME_SET_CURRENT(begin);
+			if (thread->codec->compress)
+				slices->clen[slice] =
+					thread->codec->compress_ctx(thread->ctx,
+												slices->data + slice * slices->slice_size,
+												slices->slice_size,
+												slices->compressed + slice * slices->stride,
+												slices->strategy);
+			else if (slices->clen[slice] != -1 &&
+					 thread->codec->decompress(slices->compressed + slice * slices->stride,
+											   slices->clen[slice],
+											   thread->output + j * slices->slice_size,
+											   slices->slice_size, true) != slices->slice_size)
+				bench_fail("%s decompressed the wrong size", thread->codec->name);
+			INSTR_TIME_SET_CURRENT(end);
+			INSTR_TIME_SUBTRACT(end, begin);
+
+			if (i >= bench_warmup)
+				thread->latencies[(i - bench_warmup) * thread->count + j] =
+					INSTR_TIME_GET_DOUBLE(end) * 1000000000.0;
+		}
+	}
+
+	return NULL;
+}
+
+
+/* ----------
+ * bench_throughput -
+ *
+ *		Runs one codec on nthreads threads over the slices and prints the
+ *		aggregate throughput and the latency percentiles.
+ * ----------
+ */
+static void
+bench_throughput(int payload, BenchSlices *slices, const PGLZ_Codec *codec,
+				 int nthreads, double ratio)
+{
+	BenchThread *threads = bench_malloc(nthreads * sizeof(BenchThread));
+	pthread_barrier_t barrier;
+	instr_time	begin;
+	instr_time	end;
+	double	   *latencies;
+	int64		nlatencies = slices->nslices * bench_iterations;
+	double		seconds;
+	int			t;
+
+	/* the main thread passes the barrier too, to start the clock */
+	if (pthread_barrier_init(&barrier, NULL, nthreads + 1) != 0)
+		bench_fail("could not make a barrier for %s", codec->name);
+
+	for (t = 0; t < nthreads; t++)
+	{
+		BenchThread *thread = &threads[t];
+
+		thread->id = t;
+		thread->slices = slices;
+		thread->codec = codec;
+		thread->barrier = &barrier;
+		thread->first = slices->nslices * t / nthreads;
+		thread->count = slices->nslices * (t + 1) / nthreads - thread->first;
+		thread->ctx = NULL;
+		thread->output = NULL;
+		if (codec->compress)
+		{
+			thread->ctx = bench_malloc(sizeof(PGLZ_CompressContext));
+			pglz_compress_context_init(thread->ctx);
+		}
+		else
+			thread->output = bench_malloc((size_t) thread->count * slices->slice_size +
+										  codec->dest_slack);
+		thread->latencies = bench_malloc(thread->count * bench_iterations * sizeof(double));
+		if (pthread_create(&thread->thread, NULL, bench_thread_main, thread) != 0)
+			bench_fail("could not start threads for %s", codec->name);
+	}
+
+	pthread_barrier_wait(&barrier);
+	INSTR_TIME_SET_CURRENT(begin);
+	for (t = 0; t < nthreads; t++)
+		pthread_join(threads[t].thread, NULL);
+	INSTR_TIME_SET_CURRENT(end);
+	INSTR_TIME_SUBTRACT(end, begin);
+	seconds = INSTR_TIME_GET_DOUBLE(end);
+	pthread_barrier_destroy(&barrier);
+
+	latencies = bench_malloc(nlatencies * sizeof(double));
+	nlatencies = 0;
+	for (t = 0; t < nthreads; t++)
+	{
+		BenchThread *thread = &threads[t];
+
+		memcpy(latencies + nlatencies, thread->latencies,
+			   thread->count * bench_iterations * sizeof(double));
+		nlatencies += thread->count * bench_iterations;
+		if (thread->output)
+		{
+			/* where the single-threaded benchmark checks its output */
+			memcpy(slices->output + thread->first * slices->slice_size, thread->output,
+				   (size_t) thread->count * slices->slice_size);
+			free(thread->output);
+		}
+		free(thread->ctx);
+		free(thread->latencies);
+	}
+	qsort(latencies, nlatencies, sizeof(double), bench_compare_doubles);
+
+	/* the compressors' output is checked by the vanilla decompressor */
+	if (codec->compress)
+	{
+		bench_decompress_slices(slices, &pglz_decompressors[0]);
+		ratio = bench_check_slices(slices, codec->name);
+	}
+	else
+		bench_check_slices(slices, codec->name);
+
+	/* nearest rank */
+	printf("%s\t%s\t%s\t%d\t%d\t%f\t%f\t%f\t%f\t%f\n",
+		   bench_payload_name(payload), codec->name,
+		   codec->compress ? "compression" : "decompression",
+		   slices->slice_size, nthreads,
+		   (double) slices->nslices * slices->slice_size * bench_iterations / seconds / 1e9,
+		   ratio,
+		   latencies[(int64) ceil(nlatencies * 0.5) - 1] / 1000.0,
+		   latencies[(int64) ceil(nlatencies * 0.99) - 1] / 1000.0,
+		   latencies[nlatencies - 1] / 1000.0);
+	fflush(stdout);
+
+	free(latencies);
+	free(threads);
+}
+
+
+/* ----------
+ * bench_payload_threads -
+ *
+ *		Benchmarks the selected codecs on one payload cut into slices of
+ *		slice_size with every thread count.
+ * ----------
+ */
+static void
+bench_payload_threads(int payload, const char *data, int64 size, int32 slice_size,
+					  const bool *use_compressor, const bool *use_decompressor,
+					  const int *thread_counts, int thread_count_count)
+{
+	BenchSlices slices;
+	double		vanilla_ratio;
+	int			i,
+				t;
+
+	slices.data = data;
+	slices.size = size;
+	slices.strategy = bench_payload_strategy(payload);
+	slices.slice_size = slice_size;
+	slices.nslices = size / slice_size;
+	slices.stride = PGLZ_MAX_OUTPUT(slice_size);
+	slices.compressed = bench_malloc((size_t) slices.stride * slices.nslices);
+	slices.clen = bench_malloc(slices.nslices * sizeof(int32));
+	slices.output = bench_malloc((size_t) slice_size * slices.nslices);
+
+	for (t = 0; t < thread_count_count; t++)
+	{
+		/* every thread gets at least one slice */
+		if (thread_counts[t] > slices.nslices)
+			continue;
+
+		/* the compressors of the thread count before replaced the input */
+		bench_compress_slices(&slices, &pglz_compressors[0]);
+		bench_decompress_slices(&slices, &pglz_decompressors[0]);
+		vanilla_ratio = bench_check_slices(&slices, pglz_compressors[0].name);
+
+		for (i = 0; i < pglz_decompressors_count; i++)
+		{
+			if (use_decompressor[i])
+				bench_throughput(payload, &slices, &pglz_decompressors[i], thread_counts[t],
+								 vanilla_ratio);
+		}
+
+		for (i = 0; i < pglz_compressors_count; i++)
+		{
+			if (use_compressor[i] && pglz_compressors[i].compress_ctx != NULL)
+				bench_throughput(payload, &slices, &pglz_compressors[i], thread_counts[t], 0);
+		}
+	}
+
+	free(slices.compressed);
+	free(slices.clen);
+	free(slices.output);
+}
+
+
+/* ----------
+ * bench_select_payload -
+ *
+ *		Marks a payload name or category given with -p.
+ * ----------
+ */
+static void
+bench_select_payload(const char *name, bool *use_payload)
+{
+	int			p;
+
+	if (strcmp(name, "corpus") == 0 || strcmp(name, "adversary") == 0)
+	{
+		bool		corpus = name[0] == 'c';
+
+		for (p = 0; p < (int) BENCH_PAYLOADS; p++)
+			if ((p < (int) BENCH_PAYLOAD_FILES) == corpus)
+				use_payload[p] = true;
+		return;
+	}
+
+	for (p = 0; p < (int) BENCH_PAYLOADS; p++)
+	{
+		if (strcmp(bench_payload_name(p), name) == 0)
+		{
+			use_payload[p] = true;
+			return;
+		}
+	}
+	bench_fail("unknown payload \"%s\"", name);
+}
+
+
+static int
+bench_positive(const char *arg, int min)
+{
+	char	   *end;
+	long		value = strtol(arg, &end, 10);
+
+	if (*arg == '\0' || *end != '\0' || value < min || value > PG_INT32_MAX)
+		bench_fail("invalid number \"%s\"", arg);
+	return (int) value;
+}
+
+
+int
+main(int argc, char **argv)
+{
+	bool	   *use_compressor = bench_malloc(pglz_compressors_count * sizeof(bool));
+	bool	   *use_decompressor = bench_malloc(pglz_decompressors_count * sizeof(bool));
+	bool	   *use_payload = bench_malloc(BENCH_PAYLOADS * sizeof(bool));
+	bool		any_codec = false;
+	bool		any_payload = false;
+	int32		slice_sizes[BENCH_MAX_SLICE_SIZES];
+	int			slice_count = 0;
+	int			thread_counts[BENCH_MAX_THREAD_COUNTS];
+	int			thread_count_count = 0;
+	int			c,
+				i,
+				p,
+				s;
+
+	memset(use_compressor, 0, pglz_compressors_count * sizeof(bool));
+	memset(use_decompressor, 0, pglz_decompressors_count * sizeof(bool));
+	memset(use_payload, 0, BENCH_PAYLOADS * sizeof(bool));
+
+	while ((c = getopt(argc, argv, "c:C:d:i:p:s:t:w:")) != -1)
+	{
+		const PGLZ_Codec *codec;
+
+		switch (c)
+		{
+			case 'c':
+				if ((codec = pglz_find_codec(pglz_compressors, pglz_compressors_count, optarg)) != NULL)
+					use_compressor[codec - pglz_compressors] = true;
+				else if ((codec = pglz_find_codec(pglz_decompressors, pglz_decompressors_count, optarg)) != NULL)
+					use_decompressor[codec - pglz_decompressors] = true;
+				else
+					bench_fail("unknown codec \"%s\"", optarg);
+				if (!pglz_codec_usable(codec))
+					bench_fail("codec \"%s\" needs CPU features this machine does not have", optarg);
+				any_codec = true;
+				break;
+			case 'C':
+				bench_cpu = bench_positive(optarg, 0);
+				break;
+			case 'd':
+				bench_dir = optarg;
+				break;
+			case 'i':
+				bench_iterations = bench_positive(optarg, 1);
+				break;
+			case 'p':
+				bench_select_payload(optarg, use_payload);
+				any_payload = true;
+				break;
+			case 's':
+				if (slice_count == BENCH_MAX_SLICE_SIZES)
+					bench_fail("too many slice sizes at \"%s\"", optarg);
+				slice_sizes[slice_count++] = bench_positive(optarg, 0);
+				break;
+			case 't':
+				if (thread_count_count == BENCH_MAX_THREAD_COUNTS)
+					bench_fail("too many thread counts at \"%s\"", optarg);
+				thread_counts[thread_count_count] = bench_positive(optarg, 1);
+				if (thread_counts[thread_count_count++] > BENCH_MAX_THREADS)
+					bench_fail("too many threads at \"%s\"", optarg);
+				break;
+			case 'w':
+				bench_warmup = bench_positive(optarg, 0);
+				break;
+			default:
+				bench_usage(argv[0]);
+		}
+	}
+	if (optind < argc)
+		bench_usage(argv[0]);
+
+	if (!any_codec)
+	{
+		/* all codecs this CPU can run */
+		for (i = 0; i < pglz_compressors_count; i++)
+			use_compressor[i] = pglz_codec_usable(&pglz_compressors[i]);
+		for (i = 0; i < pglz_decompressors_count; i++)
+			use_decompressor[i] = pglz_codec_usable(&pglz_decompressors[i]);
+	}
+	if (!any_payload)
+		for (p = 0; p < (int) BENCH_PAYLOADS; p++)
+			use_payload[p] = true;
+	if (slice_count == 0)
+	{
+		slice_sizes[slice_count++] = 0;
+		slice_sizes[slice_count++] = 2048;
+		slice_sizes[slice_count++] = 8192;
+	}
+
+	/* the threads pin themselves */
+	if (bench_cpu >= 0 && thread_count_count == 0)
+		bench_pin_cpu(bench_cpu);
+
+	pglz_decompress_auto_init();
+	fprintf(stderr, "pglz_decompress_auto uses %s\n", pglz_decompress_auto_name());
+
+	if (thread_count_count > 0)
+		printf("payload\tcodec\tdirection\tslice_size\tthreads\tgb_per_s\tratio\t"
+			   "p50_us\tp99_us\tmax_us\n");
+	else
+		printf("payload\tcodec\tdirection\tslice_size\tns_per_byte\tmb_per_s\tratio\t"
+			   "min_ns_per_byte\tp99_ns_per_byte\tstddev\n");
+	for (p = 0; p < (int) BENCH_PAYLOADS; p++)
+	{
+		char	   *data;
+		int64		size;
+
+		if (!use_payload[p])
+			continue;
+		data = bench_load_payload(p, &size);
+
+		for (s = 0; s < slice_count; s++)
+		{
+			/* too big to make a single slice */
+			if (slice_sizes[s] > size)
+				continue;
+			if (thread_count_count == 0)
+				bench_payload(p, data, size, slice_sizes[s], use_compressor,
+							  use_decompressor);
+			else if (slice_sizes[s] > 0)
+				bench_payload_threads(p, data, size, slice_sizes[s], use_compressor,
+									  use_decompressor, thread_counts, thread_count_count);
+		}
+		free(data);
+	}
+
+	free(use_compressor);
+	free(use_decompressor);
+	free(use_payload);
+	return 0;
+}
@@ -0,0 +1,52 @@
+/* ----------
+ * postgres.h -
+ *
+ *		Stand-in for the server's postgres.h in the standalone benchmark.
+ *
+ *		The codec modules only need the integer types and a few macros of
+ *		c.h, so this lets them build without a PostgreSQL tree.  Nothing
+ *		here is meant to be complete; add what a module starts to use.
+ *
+ * Copyright (c) 1999-2019, PostgreSQL Global Development Group
+ *
+ * contrib/test_pglz/standalone/postgres.h
+ * ----------
+ */
+#ifndef POSTGRES_H
+#define POSTGRES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef int8_t int8;
+typedef uint8_t uint8;
+typedef int16_t int16;
+typedef uint16_t uint16;
+typedef int32_t int32;
+typedef uint32_t uint32;
+typedef int64_t int64;
+typedef uint64_t uint64;
+typedef size_t Size;
+
+#define Min(x, y)		((x) < (y) ? (x) : (y))
+#define Max(x, y)		((x) > (y) ? (x) : (y))
+#define lengthof(array) (sizeof (array) / sizeof ((array)[0]))
+
+#define PG_INT32_MAX	INT32_MAX
+#define INT64CONST(x)	INT64_C(x)
+#define UINT64CONST(x)	UINT64_C(x)
+
+#define likely(x)		__builtin_expect((x) != 0, 1)
+#define unlikely(x)		__builtin_expect((x) != 0, 0)
+
+#define pg_attribute_always_inline __attribute__((always_inline)) inline
+#define pg_attribute_unused()	__attribute__((unused))
+#define pg_noinline				__attribute__((noinline))
+
+#define Assert(condition)	((void) 0)
+
+#endif							/* POSTGRES_H */
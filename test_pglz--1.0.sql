@@ -3,6 +3,145 @@
 -- complain if script is sourced in psql, rather than via CREATE EXTENSION
 \echo Use "CREATE EXTENSION test_pglz" to load this file. \quit
 
-CREATE FUNCTION test_pglz()
+CREATE FUNCTION test_pglz(codecs text[] DEFAULT NULL,
+                          payloads text[] DEFAULT NULL,
+                          slice_sizes integer[] DEFAULT '{0,2048,8192}',
+                          iterations integer DEFAULT 5,
+                          warmup integer DEFAULT 1,
+                          perf boolean DEFAULT false,
+                          OUT payload text,
+                          OUT codec text,
+                          OUT direction text,
+                          OUT slice_size integer,
+                          OUT ns_per_byte float8,
+                          OUT mb_per_s float8,
+                          OUT ratio float8,
+                          OUT min_ns_per_byte float8,
+                          OUT p99_ns_per_byte float8,
+                          OUT stddev float8,
+                          OUT rejected_share float8,
+                          OUT rejected_ns_per_byte float8,
+                          OUT setup_ns_per_datum float8,
+                          OUT cycles_per_byte float8,
+                          OUT ipc float8,
+                          OUT branch_misses_per_byte float8,
+                          OUT l1d_misses_per_byte float8,
+                          OUT llc_misses_per_byte float8)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION test_pglz_parallel(max_threads integer DEFAULT 8,
+                                   slice_size integer DEFAULT 4096)
+RETURNS pg_catalog.void STRICT
+AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION test_pglz_levels(slice_size integer DEFAULT 0)
 RETURNS pg_catalog.void STRICT
 AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION test_pglz_stream(chunk_size integer DEFAULT 65536)
+RETURNS pg_catalog.void STRICT
+AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION test_pglz_verify(payloads text[] DEFAULT NULL,
+                                 slice_sizes integer[] DEFAULT '{0,2048,8192}',
+                                 OUT payload text,
+                                 OUT compressor text,
+                                 OUT decompressor text,
+                                 OUT slice_size integer,
+                                 OUT slices integer,
+                                 OUT failures integer,
+                                 OUT first_failure text)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION test_pglz_range(payloads text[] DEFAULT NULL,
+                                block_size integer DEFAULT 65536,
+                                range_size integer DEFAULT 4096,
+                                ranges integer DEFAULT 16,
+                                OUT payload text,
+                                OUT block_size integer,
+                                OUT range_size integer,
+                                OUT plain_ratio float8,
+                                OUT ratio float8,
+                                OUT plain_us float8,
+                                OUT range_us float8,
+                                OUT speedup float8)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION test_pglz_dict(payloads text[] DEFAULT NULL,
+                               slice_size integer DEFAULT 2048,
+                               dict_size integer DEFAULT 4094,
+                               training_stride integer DEFAULT 16,
+                               OUT payload text,
+                               OUT slice_size integer,
+                               OUT dict_size integer,
+                               OUT ratio float8,
+                               OUT dict_ratio float8,
+                               OUT compression_ns_per_byte float8,
+                               OUT dict_compression_ns_per_byte float8,
+                               OUT decompression_ns_per_byte float8,
+                               OUT dict_decompression_ns_per_byte float8,
+                               OUT training_ms float8)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION test_pglz2(payloads text[] DEFAULT NULL,
+                           slice_sizes integer[] DEFAULT '{0,8192,65536}',
+                           OUT payload text,
+                           OUT slice_size integer,
+                           OUT ratio float8,
+                           OUT pglz2_ratio float8,
+                           OUT compression_ns_per_byte float8,
+                           OUT pglz2_compression_ns_per_byte float8,
+                           OUT decompression_ns_per_byte float8,
+                           OUT pglz2_decompression_ns_per_byte float8)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION test_pglz_stats(payloads text[] DEFAULT NULL,
+                                slice_sizes integer[] DEFAULT '{0,2048,8192}',
+                                OUT payload text,
+                                OUT slice_size integer,
+                                OUT literal_share float8,
+                                OUT matches int8,
+                                OUT mean_match_length float8,
+                                OUT lookups int8,
+                                OUT mean_chain_length float8,
+                                OUT good_match_stops int8,
+                                OUT good_match_decay_stops int8,
+                                OUT chain_length int8[],
+                                OUT match_length int8[],
+                                OUT match_offset int8[],
+                                OUT copies int8,
+                                OUT overlapping_copies int8,
+                                OUT copy_offset int8[])
+RETURNS SETOF record
+AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION test_pglz_scatter(payloads text[] DEFAULT NULL,
+                                  slice_sizes integer[] DEFAULT '{2048,8192,65536}',
+                                  segment_size integer DEFAULT 1996,
+                                  OUT payload text,
+                                  OUT slice_size integer,
+                                  OUT segment_size integer,
+                                  OUT compression_ns_per_byte float8,
+                                  OUT bounded_compression_ns_per_byte float8,
+                                  OUT decompression_ns_per_byte float8,
+                                  OUT scatter_decompression_ns_per_byte float8)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION test_pglz_pipeline(payloads text[] DEFAULT NULL,
+                                   slice_sizes integer[] DEFAULT '{2048,8192}',
+                                   distance integer DEFAULT 4,
+                                   OUT payload text,
+                                   OUT slice_size integer,
+                                   OUT distance integer,
+                                   OUT decompression_ns_per_byte float8,
+                                   OUT prefetch_ns_per_byte float8,
+                                   OUT background_ns_per_byte float8,
+                                   OUT overlap float8)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME' LANGUAGE C;
@@ -13,82 +13,52 @@
 #include "postgres.h"
 
 #include "fmgr.h"
+#include "funcapi.h"
+#include "catalog/pg_type.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
 #include "utils/memutils.h"
+#include "utils/tuplestore.h"
 #include "utils/timestamp.h"
 #include "miscadmin.h"
 
 #include <limits.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
 
 #include "common/pg_lzcompress.h"
+#include "pg_lzcompress_hacked.h"
+#include "portability/instr_time.h"
 
 
 PG_MODULE_MAGIC;
 
-PG_FUNCTION_INFO_V1(test_pglz);
-
-typedef int32 (*decompress_func)(const char *source, int32 slen, char *dest,
-						 int32 rawsize, bool check_complete);
-
-typedef int32 (*compress_func)(const char *source, int32 slen, char *dest,
-			  const PGLZ_Strategy *strategy);
-
-
-int32
-pglz_compress_vanilla(const char *source, int32 slen, char *dest,
-			  const PGLZ_Strategy *strategy);
-
-int32
-pglz_compress_hacked(const char *source, int32 slen, char *dest,
-			  const PGLZ_Strategy *strategy);
-int32
-pglz_decompress_hacked_unrolled(const char *source, int32 slen, char *dest,
-			  const PGLZ_Strategy *strategy);
-int32
-pglz_decompress_vanilla(const char *source, int32 slen, char *dest,
-						 int32 rawsize, bool check_complete);
-int32
-pglz_decompress_hacked(const char *source, int32 slen, char *dest,
-						 int32 rawsize, bool check_complete);
-
-int32
-pglz_decompress_hacked8(const char *source, int32 slen, char *dest,
-						 int32 rawsize, bool check_complete);
-
-int32
-pglz_decompress_hacked16(const char *source, int32 slen, char *dest,
-						 int32 rawsize, bool check_complete);
+void _PG_init(void);
 
+PG_FUNCTION_INFO_V1(test_pglz);
+PG_FUNCTION_INFO_V1(test_pglz_parallel);
+PG_FUNCTION_INFO_V1(test_pglz_levels);
+PG_FUNCTION_INFO_V1(test_pglz_stream);
+PG_FUNCTION_INFO_V1(test_pglz_verify);
+PG_FUNCTION_INFO_V1(test_pglz_range);
+PG_FUNCTION_INFO_V1(test_pglz_dict);
+PG_FUNCTION_INFO_V1(test_pglz2);
+PG_FUNCTION_INFO_V1(test_pglz_stats);
+PG_FUNCTION_INFO_V1(test_pglz_scatter);
+PG_FUNCTION_INFO_V1(test_pglz_pipeline);
 
-double do_test(int compressor, int decompressor, int payload, bool decompression_time);
-double do_sliced_test(int compressor, int decompressor, int payload, int slice_size, bool decompression_time);
-
-compress_func compressors[] = {pglz_compress_vanilla, pglz_compress_hacked};
-char *compressor_name[] = {"pglz_compress_vanilla", "pglz_compress_hacked"};
-int compressors_count = 2;
-
-decompress_func decompressors[] =
-{
-	pglz_decompress_vanilla,
-	pglz_decompress_hacked,
-	pglz_decompress_hacked_unrolled,
-	pglz_decompress_hacked8,
-	pglz_decompress_hacked16,
-	pglz_decompress_vanilla,
-};
-char *decompressor_name[] = 
-{
-	"pglz_decompress_vanilla - warmup", /* do vanilla test at the beginning and at the end */
-	"pglz_decompress_hacked",
-	//"pglz_decompress_hacked_unrolled",
-	"pglz_decompress_hacked8",
-	//"pglz_decompress_hacked16",
-	"pglz_decompress_vanilla",
-};
-
-int decompressors_count = 4;
+double do_test(int compressor, int decompressor, int payload, bool decompression_time, PGLZ_PerfCounters *perf);
+double do_sliced_test(int compressor, int decompressor, int payload, int slice_size, bool decompression_time,
+					  PGLZ_PerfCounters *perf);
+double do_ratio_test(int compressor, int payload, int slice_size, double *rejected_share, double *rejected_ns_per_byte);
+double do_setup_test(int compressor, int payload, int slice_size);
+void do_parallel_test(int payload, int slice_size, int nthreads, double *compression_result, double *decompression_result);
+void do_level_test(const PGLZ_StrategyExt *strategy, int payload, int slice_size, double *compression_result, double *decompression_result, double *ratio);
 
-char *payload_names[] =
+/* the payload files, followed in payload_names by pglz_adversaries[] */
+char *payload_files[] =
 {
 	"000000010000000000000001",
 	"000000010000000000000006",
@@ -97,40 +67,95 @@ char *payload_names[] =
 	"shakespeare.txt",
 	"mr","dickens","mozilla","nci","ooffice","osdb","reymont","samba","sao","webster","x-ray","xml"
 };
+int payload_file_count = lengthof(payload_files);
+char **payload_names;
 void **payloads;
 long *payload_sizes;
-int payload_count = 17;
+int payload_count;
+
+/*
+ * Module load callback: list the payloads and choose the decompressor
+ * behind pglz_decompress_auto before anything is timed.
+ */
+void
+_PG_init(void)
+{
+	int i;
+
+	payload_count = payload_file_count + pglz_adversaries_count;
+	payload_names = MemoryContextAlloc(TopMemoryContext, sizeof(char *) * payload_count);
+	for (i = 0; i < payload_file_count; i++)
+		payload_names[i] = payload_files[i];
+	for (i = 0; i < pglz_adversaries_count; i++)
+		payload_names[payload_file_count + i] = (char *) pglz_adversaries[i].name;
+
+	pglz_decompress_auto_init();
+	elog(DEBUG1, "pglz_decompress_auto uses %s", pglz_decompress_auto_name());
+}
+
+/*
+ * The strategy the benchmark compresses a payload with. Under
+ * PGLZ_strategy_default the hacked compressors give up early on input that
+ * looks incompressible, see pglz_looks_incompressible(), which would time
+ * that early exit instead of the worst cases the adversary payloads are
+ * built for; PGLZ_strategy_always turns the heuristic off.
+ */
+static const PGLZ_Strategy *payload_strategy(int payload)
+{
+	return payload >= payload_file_count ? PGLZ_strategy_always : PGLZ_strategy_default;
+}
 
-/* benchmark returns ns per byte of payload to decompress */
-double do_test(int compressor, int decompressor, int payload, bool decompression_time)
+/*
+ * benchmark returns ns per byte of payload to decompress; if perf is not
+ * NULL its counters run during the timed direction
+ */
+double do_test(int compressor, int decompressor, int payload, bool decompression_time, PGLZ_PerfCounters *perf)
 {
 	ereport(LOG,
 		(errmsg("Testing payload %s\tcompressor %s\tdecompressor %s",
-			payload_names[payload], compressor_name[compressor], decompressor_name[decompressor]),
+			payload_names[payload], pglz_compressors[compressor].name, pglz_decompressors[decompressor].name),
 		errhidestmt(true)));
 	void *data = payloads[payload];
 	long size = payload_sizes[payload];
-	void *extracted_data = palloc(size);
+	void *extracted_data = palloc(size + pglz_decompressors[decompressor].dest_slack);
 	void *compressed = palloc(size * 2);
 
-	compressors[compressor](data, size, compressed, PGLZ_strategy_default);
-	clock_t compression_begin = clock();
-	int comp_size = compressors[compressor](data, size, compressed, PGLZ_strategy_default);
-	clock_t copmression_end = clock();
+	instr_time compression_begin;
+	instr_time compression_end;
+	instr_time decompression_begin;
+	instr_time decompression_end;
+
+	pglz_compressors[compressor].compress(data, size, compressed, payload_strategy(payload));
+	if (perf && !decompression_time)
+		pglz_perf_start(perf);
+	INSTR_TIME_SET_CURRENT(compression_begin);
+	int comp_size = pglz_compressors[compressor].compress(data, size, compressed, payload_strategy(payload));
+	INSTR_TIME_SET_CURRENT(compression_end);
+	if (perf && !decompression_time)
+		pglz_perf_stop(perf);
+
+	if (perf && decompression_time)
+		pglz_perf_start(perf);
+	INSTR_TIME_SET_CURRENT(decompression_begin);
+	int decompressed_size = pglz_decompressors[decompressor].decompress(compressed, comp_size, extracted_data, size, true);
+	INSTR_TIME_SET_CURRENT(decompression_end);
+	if (perf && decompression_time)
+		pglz_perf_stop(perf);
 
-	clock_t decompression_begin = clock();
-	if (decompressors[decompressor](compressed, comp_size, extracted_data, size, true) != size)
-	{}
-	//	elog(ERROR, "decompressed wrong size %d instead of %d",decompressors[decompressor](compressed, comp_size, extracted_data, size, true),size);
-	clock_t decopmression_end = clock();
+	/* an incompressible payload leaves nothing to decompress */
+	if (comp_size != -1)
+	{
+		if (decompressed_size != size)
+			elog(ERROR, "decompressed wrong size %d instead of %ld", decompressed_size, size);
+		if (memcmp(extracted_data, data, size))
+			elog(ERROR, "decompressed different data");
+	}
 
-	//if (memcmp(extracted_data, data, size))
-	//	elog(ERROR, "decompressed different data");
-	
+	INSTR_TIME_SUBTRACT(compression_end, compression_begin);
+	INSTR_TIME_SUBTRACT(decompression_end, decompression_begin);
 	ereport(LOG,
-		(errmsg("Compression %ld\t(%f seconds)\tDecompression %ld\t(%f seconds)\tRatio %f",
-			copmression_end - compression_begin, ((float)copmression_end - compression_begin) / CLOCKS_PER_SEC,
-			decopmression_end - decompression_begin, ((float)decopmression_end - decompression_begin) / CLOCKS_PER_SEC,
+		(errmsg("Compression %f seconds\tDecompression %f seconds\tRatio %f",
+			INSTR_TIME_GET_DOUBLE(compression_end), INSTR_TIME_GET_DOUBLE(decompression_end),
 			comp_size/(float)size),
 		errhidestmt(true)));
 
@@ -138,16 +163,17 @@ double do_test(int compressor, int decompressor, int payload, bool decompression
 	pfree(compressed);
 
 	if (decompression_time)
-		return ((double)decopmression_end - decompression_begin) * (1000000000.0L / size) / CLOCKS_PER_SEC;
+		return INSTR_TIME_GET_DOUBLE(decompression_end) * (1000000000.0L / size);
 	else
-		return ((double)copmression_end - compression_begin) * (1000000000.0L / size) / CLOCKS_PER_SEC;
+		return INSTR_TIME_GET_DOUBLE(compression_end) * (1000000000.0L / size);
 }
 
-double do_sliced_test(int compressor, int decompressor, int payload, int slice_size, bool decompression_time)
+double do_sliced_test(int compressor, int decompressor, int payload, int slice_size, bool decompression_time,
+					  PGLZ_PerfCounters *perf)
 {
 	ereport(LOG,
 		(errmsg("Testing %dKb slicing payload %s\tcompressor %s\tdecompressor %s", slice_size / 1024,
-			payload_names[payload], compressor_name[compressor], decompressor_name[decompressor]),
+			payload_names[payload], pglz_compressors[compressor].name, pglz_decompressors[decompressor].name),
 		errhidestmt(true)));
 	char *data = payloads[payload];
 	long size = payload_sizes[payload];
@@ -162,21 +188,38 @@ double do_sliced_test(int compressor, int decompressor, int payload, int slice_s
 		compressed[i] = palloc(slice_size * 2);
 	}
 
-	clock_t compression_begin = clock();
+	instr_time compression_begin;
+	instr_time compression_end;
+	instr_time decompression_begin;
+	instr_time decompression_end;
+
+	if (perf && !decompression_time)
+		pglz_perf_start(perf);
+	INSTR_TIME_SET_CURRENT(compression_begin);
 	for (i = 0; i < slice_count; i++)
-		comp_size[i] = compressors[compressor](data + slice_size * i, slice_size, compressed[i], PGLZ_strategy_default);
-	clock_t compression_end = clock();
+		comp_size[i] = pglz_compressors[compressor].compress(data + slice_size * i, slice_size, compressed[i], payload_strategy(payload));
+	INSTR_TIME_SET_CURRENT(compression_end);
+	if (perf && !decompression_time)
+		pglz_perf_stop(perf);
 
-	clock_t decompression_begin = clock();
+	if (perf && decompression_time)
+		pglz_perf_start(perf);
+	INSTR_TIME_SET_CURRENT(decompression_begin);
 	for (i = 0; i < slice_count; i++)
 	{
 		if (comp_size[i] == -1)
 			continue; /* no decompression */
-		int decompressed_size = decompressors[decompressor](compressed[i], comp_size[i], extracted_data[i], slice_size, false);
+		int decompressed_size = pglz_decompressors[decompressor].decompress(compressed[i], comp_size[i], extracted_data[i], slice_size, false);
 		if (decompressed_size != slice_size)
 			elog(ERROR, "decompressed wrong size %d instead of %d, compressed size %d", decompressed_size, slice_size, comp_size[i]);
 	}
-	clock_t decopmression_end = clock();
+	INSTR_TIME_SET_CURRENT(decompression_end);
+	if (perf && decompression_time)
+		pglz_perf_stop(perf);
+
+	for (i = 0; i < slice_count; i++)
+		if (comp_size[i] != -1 && memcmp(extracted_data[i], data + slice_size * i, slice_size))
+			elog(ERROR, "decompressed different data, compressed size %d", comp_size[i]);
 
 	for (i = 0; i< slice_count; i++)
 	{
@@ -187,174 +230,1774 @@ double do_sliced_test(int compressor, int decompressor, int payload, int slice_s
 	pfree(comp_size);
 	pfree(compressed);
 
+	INSTR_TIME_SUBTRACT(compression_end, compression_begin);
+	INSTR_TIME_SUBTRACT(decompression_end, decompression_begin);
 	if (decompression_time)
-		return ((double)decopmression_end - decompression_begin) * (1000000000.0L / size) / CLOCKS_PER_SEC;
+		return INSTR_TIME_GET_DOUBLE(decompression_end) * (1000000000.0L / size);
 	else
-		return ((double)compression_end - compression_begin) * (1000000000.0L / size) / CLOCKS_PER_SEC;
+		return INSTR_TIME_GET_DOUBLE(compression_end) * (1000000000.0L / size);
 }
 
-static void prepare_payloads()
+/*
+ * Distribution of the per-iteration results of one benchmark, and the
+ * hardware counters over all iterations per byte of payload, -1 if not
+ * counted
+ */
+typedef struct bench_stats
+{
+	double min;
+	double median;
+	double p99;
+	double mean;
+	double stddev;
+	double cycles_per_byte;
+	double ipc;
+	double branch_misses_per_byte;
+	double l1d_misses_per_byte;
+	double llc_misses_per_byte;
+} bench_stats;
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* Counts per byte of payload, -1 if the event was not counted */
+static double perf_per_byte(int64 count, double bytes)
+{
+	return count < 0 ? -1 : count / bytes;
+}
+
+/*
+ * Runs do_test() (slice_size 0) or do_sliced_test() warmup times without
+ * looking at the results, then iterations times, and summarizes those.
+ * With perf the iterations also run the hardware counters.
+ */
+static void do_benchmark(int compressor, int decompressor, int payload, int slice_size, bool decompression_time,
+						 int warmup, int iterations, bool perf, bench_stats *stats)
+{
+	double *samples = palloc(iterations * sizeof(double));
+	double sum = 0;
+	double squares = 0;
+	PGLZ_PerfCounters counters;
+	int64 counts[PGLZ_PERF_EVENTS];
+	double bytes;
+	int i;
+
+	if (perf && !pglz_perf_open(&counters))
+		ereport(ERROR,
+				(errmsg("could not open hardware performance counters: %m"),
+				 errhint("Counting needs a PMU and kernel.perf_event_paranoid of 2 or less.")));
+
+	for (i = 0; i < warmup + iterations; i++)
+	{
+		PGLZ_PerfCounters *iteration_counters = perf && i >= warmup ? &counters : NULL;
+		double result;
+
+		if (slice_size == 0)
+			result = do_test(compressor, decompressor, payload, decompression_time, iteration_counters);
+		else
+			result = do_sliced_test(compressor, decompressor, payload, slice_size, decompression_time,
+									iteration_counters);
+		if (i >= warmup)
+			samples[i - warmup] = result;
+	}
+
+	stats->cycles_per_byte = stats->ipc = -1;
+	stats->branch_misses_per_byte = stats->l1d_misses_per_byte = stats->llc_misses_per_byte = -1;
+	if (perf)
+	{
+		pglz_perf_read(&counters, counts);
+		pglz_perf_close(&counters);
+
+		/* per byte of payload, like the times */
+		bytes = (double) payload_sizes[payload] * iterations;
+		stats->cycles_per_byte = perf_per_byte(counts[PGLZ_PERF_CYCLES], bytes);
+		if (counts[PGLZ_PERF_INSTRUCTIONS] >= 0 && counts[PGLZ_PERF_CYCLES] > 0)
+			stats->ipc = counts[PGLZ_PERF_INSTRUCTIONS] / (double) counts[PGLZ_PERF_CYCLES];
+		stats->branch_misses_per_byte = perf_per_byte(counts[PGLZ_PERF_BRANCH_MISSES], bytes);
+		stats->l1d_misses_per_byte = perf_per_byte(counts[PGLZ_PERF_L1D_MISSES], bytes);
+		stats->llc_misses_per_byte = perf_per_byte(counts[PGLZ_PERF_LLC_MISSES], bytes);
+	}
+
+	qsort(samples, iterations, sizeof(double), compare_doubles);
+	for (i = 0; i < iterations; i++)
+		sum += samples[i];
+	stats->mean = sum / iterations;
+	for (i = 0; i < iterations; i++)
+		squares += (samples[i] - stats->mean) * (samples[i] - stats->mean);
+	stats->stddev = iterations > 1 ? sqrt(squares / (iterations - 1)) : 0;
+	stats->min = samples[0];
+	stats->median = iterations % 2 ? samples[iterations / 2] :
+		(samples[iterations / 2 - 1] + samples[iterations / 2]) / 2;
+	/* nearest rank */
+	stats->p99 = samples[(int) ceil(iterations * 0.99) - 1];
+
+	pfree(samples);
+}
+
+/*
+ * Returns compressed size divided by payload size, with slices that fail to
+ * compress counted as stored raw. slice_size of 0 compresses the payload as
+ * a whole. Also returns the share of the payload in slices that failed and
+ * the ns per byte spent on those, which is how quickly incompressible data
+ * is given up on; both are -1 if no slice failed.
+ */
+double do_ratio_test(int compressor, int payload, int slice_size, double *rejected_share, double *rejected_ns_per_byte)
+{
+	char *data = payloads[payload];
+	long size = payload_sizes[payload];
+	long total = 0;
+	long rejected = 0;
+	double rejected_time = 0;
+	long offset;
+	char *compressed;
+
+	if (slice_size == 0)
+		slice_size = size;
+	compressed = palloc(PGLZ_MAX_OUTPUT(slice_size));
+
+	for (offset = 0; offset + slice_size <= size; offset += slice_size)
+	{
+		instr_time begin;
+		instr_time end;
+		int comp_size;
+
+		INSTR_TIME_SET_CURRENT(begin);
+		comp_size = pglz_compressors[compressor].compress(data + offset, slice_size, compressed, PGLZ_strategy_default);
+		INSTR_TIME_SET_CURRENT(end);
+
+		if (comp_size == -1)
+		{
+			INSTR_TIME_SUBTRACT(end, begin);
+			rejected += slice_size;
+			rejected_time += INSTR_TIME_GET_DOUBLE(end);
+		}
+		total += comp_size == -1 ? slice_size : comp_size;
+	}
+
+	pfree(compressed);
+
+	*rejected_share = rejected == 0 ? -1 : rejected / (double) offset;
+	*rejected_ns_per_byte = rejected == 0 ? -1 : rejected_time * 1000000000.0 / rejected;
+
+	return offset == 0 ? 1.0 : total / (double) offset;
+}
+
+/*
+ * Returns the ns per slice the compressor spends before it looks at the
+ * first byte: every slice is compressed with the default strategy, except
+ * that first_success_by is 0, so the compressor gives up as soon as its
+ * setup is done. That is the overhead each datum pays whatever its size.
+ * The best of a few passes is taken, as the figure is small. Returns -1,
+ * not measured, if the payload has no whole slice of slice_size.
+ */
+double do_setup_test(int compressor, int payload, int slice_size)
+{
+	char *data = payloads[payload];
+	long size = payload_sizes[payload];
+	int slice_count;
+	PGLZ_Strategy strategy = *PGLZ_strategy_default;
+	char *compressed;
+	double best = -1;
+	int pass;
+	int i;
+
+	if (slice_size <= 0 || size / slice_size == 0)
+		return -1;
+	slice_count = size / slice_size;
+	compressed = palloc(PGLZ_MAX_OUTPUT(slice_size));
+
+	strategy.first_success_by = 0;
+	for (pass = 0; pass < 3; pass++)
+	{
+		instr_time begin;
+		instr_time end;
+
+		INSTR_TIME_SET_CURRENT(begin);
+		for (i = 0; i < slice_count; i++)
+			pglz_compressors[compressor].compress(data + (Size) slice_size * i, slice_size, compressed, &strategy);
+		INSTR_TIME_SET_CURRENT(end);
+		INSTR_TIME_SUBTRACT(end, begin);
+		if (best < 0 || INSTR_TIME_GET_DOUBLE(end) < best)
+			best = INSTR_TIME_GET_DOUBLE(end);
+	}
+
+	pfree(compressed);
+
+	return best * 1000000000.0 / slice_count;
+}
+
+/*
+ * Benchmark of the batch API: all slices of the payload are compressed and
+ * then decompressed with nthreads threads. Both results are wall clock ns
+ * per byte of payload, the only meaningful measure with several threads.
+ */
+void do_parallel_test(int payload, int slice_size, int nthreads, double *compression_result, double *decompression_result)
+{
+	char *data = payloads[payload];
+	long size = payload_sizes[payload];
+	int slice_count = size / slice_size;
+	PGLZ_Slice *slices = palloc(slice_count * sizeof(PGLZ_Slice));
+	PGLZ_Slice *compressed_slices = palloc(slice_count * sizeof(PGLZ_Slice));
+	char *compressed = palloc((Size) slice_count * PGLZ_MAX_OUTPUT(slice_size));
+	char *extracted_data = palloc((Size) slice_count * slice_size);
+	int compressed_count = 0;
+	instr_time compression_begin;
+	instr_time compression_end;
+	instr_time decompression_begin;
+	instr_time decompression_end;
+	int i;
+
+	for (i = 0; i < slice_count; i++)
+	{
+		slices[i].source = data + (Size) slice_size * i;
+		slices[i].slen = slice_size;
+		slices[i].dest = compressed + (Size) PGLZ_MAX_OUTPUT(slice_size) * i;
+		slices[i].rawsize = slice_size;
+	}
+
+	INSTR_TIME_SET_CURRENT(compression_begin);
+	pglz_compress_batch(slices, slice_count, PGLZ_strategy_default, nthreads);
+	INSTR_TIME_SET_CURRENT(compression_end);
+
+	/* Incompressible slices would be stored raw, so they are not decompressed */
+	for (i = 0; i < slice_count; i++)
+	{
+		if (slices[i].result == -1)
+			continue;
+		compressed_slices[compressed_count].source = slices[i].dest;
+		compressed_slices[compressed_count].slen = slices[i].result;
+		compressed_slices[compressed_count].dest = extracted_data + (Size) slice_size * i;
+		compressed_slices[compressed_count].rawsize = slice_size;
+		compressed_count++;
+	}
+
+	INSTR_TIME_SET_CURRENT(decompression_begin);
+	pglz_decompress_batch(compressed_slices, compressed_count,
+						  pglz_decompress_hacked, false, nthreads);
+	INSTR_TIME_SET_CURRENT(decompression_end);
+
+	for (i = 0; i < compressed_count; i++)
+		if (compressed_slices[i].result != slice_size)
+			elog(ERROR, "decompressed wrong size %d instead of %d, compressed size %d",
+				 compressed_slices[i].result, slice_size, compressed_slices[i].slen);
+
+	pfree(slices);
+	pfree(compressed_slices);
+	pfree(compressed);
+	pfree(extracted_data);
+
+	INSTR_TIME_SUBTRACT(compression_end, compression_begin);
+	INSTR_TIME_SUBTRACT(decompression_end, decompression_begin);
+	*compression_result = INSTR_TIME_GET_DOUBLE(compression_end) * (1000000000.0L / size);
+	*decompression_result = INSTR_TIME_GET_DOUBLE(decompression_end) * (1000000000.0L / size);
+}
+
+/*
+ * Compresses all slices of the payload with a leveled strategy and
+ * decompresses them back. Times are ns per byte of payload; the ratio counts
+ * slices that fail to compress as stored raw, and such slices are not
+ * decompressed. slice_size of 0 compresses the payload as a whole.
+ */
+void do_level_test(const PGLZ_StrategyExt *strategy, int payload, int slice_size, double *compression_result, double *decompression_result, double *ratio)
 {
-	payloads = palloc(sizeof(void*) * payload_count);
-	payload_sizes = palloc(sizeof(long) * payload_count);
+	char *data = payloads[payload];
+	long size = payload_sizes[payload];
+	int slice_count;
+	int32 *compressed_sizes;
+	char *compressed;
+	char *extracted_data;
+	long total = 0;
+	instr_time compression_begin;
+	instr_time compression_end;
+	instr_time decompression_begin;
+	instr_time decompression_end;
+	int i;
+
+	if (slice_size == 0)
+		slice_size = size;
+	slice_count = size / slice_size;
+	compressed_sizes = palloc(slice_count * sizeof(int32));
+	compressed = palloc((Size) slice_count * PGLZ_MAX_OUTPUT(slice_size));
+	extracted_data = palloc(slice_size);
+
+	INSTR_TIME_SET_CURRENT(compression_begin);
+	for (i = 0; i < slice_count; i++)
+		compressed_sizes[i] = pglz_compress_level(data + (Size) slice_size * i, slice_size,
+												  compressed + (Size) PGLZ_MAX_OUTPUT(slice_size) * i,
+												  strategy);
+	INSTR_TIME_SET_CURRENT(compression_end);
+
+	INSTR_TIME_SET_CURRENT(decompression_begin);
+	for (i = 0; i < slice_count; i++)
+	{
+		if (compressed_sizes[i] == -1)
+			continue;
+		if (pglz_decompress_hacked(compressed + (Size) PGLZ_MAX_OUTPUT(slice_size) * i, compressed_sizes[i],
+								   extracted_data, slice_size, true) != slice_size)
+			elog(ERROR, "decompressed wrong size, compressed size %d", compressed_sizes[i]);
+	}
+	INSTR_TIME_SET_CURRENT(decompression_end);
+
+	for (i = 0; i < slice_count; i++)
+		total += compressed_sizes[i] == -1 ? slice_size : compressed_sizes[i];
+
+	pfree(compressed_sizes);
+	pfree(compressed);
+	pfree(extracted_data);
+
+	INSTR_TIME_SUBTRACT(compression_end, compression_begin);
+	INSTR_TIME_SUBTRACT(decompression_end, decompression_begin);
+	*compression_result = INSTR_TIME_GET_DOUBLE(compression_end) * (1000000000.0L / size);
+	*decompression_result = INSTR_TIME_GET_DOUBLE(decompression_end) * (1000000000.0L / size);
+	*ratio = total / ((double) slice_count * slice_size);
+}
 
+static FILE *open_payload(int payload)
+{
 	char share_path[MAXPGPATH];
 	char path[MAXPGPATH];
-	FILE *f;
-	long size;
-	int i;
 
-	for (i=0; i< payload_count; i++)
+	get_share_path(my_exec_path, share_path);
+	snprintf(path, MAXPGPATH, "%s/extension/%s", share_path, payload_names[payload]);
+	return fopen(path, "r");
+}
+
+/*
+ * Feeds one piece of a compressed stream to the streaming decompressor and
+ * checks the output against the payload file read alongside. The time spent
+ * in the decompressor is added to *time.
+ */
+static void stream_decompress_and_check(PGLZ_StreamDecompressState *state, const char *source, int32 slen,
+										char *extracted_data, char *expected_data, int32 buffer_size,
+										FILE *expected, instr_time *time)
+{
+	for (;;)
 	{
-		get_share_path(my_exec_path, share_path);
-		snprintf(path, MAXPGPATH, "%s/extension/%s", share_path, payload_names[i]);
-		f = fopen(path, "r");
-		if (!f)
-			elog(ERROR, "unable to open payload");
+		instr_time begin;
+		instr_time end;
+		int32 consumed;
+		int32 size;
 
-		fseek (f , 0 , SEEK_END);
-		size = ftell (f);
-		rewind (f);
-		
-		void* data = palloc(size);
+		INSTR_TIME_SET_CURRENT(begin);
+		size = pglz_stream_decompress_feed(state, source, slen, &consumed, extracted_data, buffer_size);
+		INSTR_TIME_SET_CURRENT(end);
+		INSTR_TIME_ACCUM_DIFF(*time, end, begin);
 
-		if (fread(data, size, 1, f) != 1)
-			elog(ERROR, "unable to read payload");
-		fclose(f);
-		payloads[i] = data;
-		payload_sizes[i] = size;
+		if (size == -1)
+			elog(ERROR, "corrupt stream");
+		if (size > 0 && (fread(expected_data, size, 1, expected) != 1 ||
+						 memcmp(extracted_data, expected_data, size) != 0))
+			elog(ERROR, "decompressed stream differs from the payload");
+
+		source += consumed;
+		slen -= consumed;
+		if (slen == 0 && size < buffer_size)
+			break;
 	}
 }
 
 /*
- * SQL-callable entry point to perform all tests.
+ * Streams the payload file through the compressor and the decompressor in
+ * chunks. Only the chunk buffers and the stream states are in memory, the
+ * payload is never loaded as a whole.
  */
-Datum
-test_pglz(PG_FUNCTION_ARGS)
+static void do_stream_test(int payload, int chunk_size, double *compression_result, double *decompression_result, double *ratio)
 {
-	double decompression_results[10][10];
-	double decompression_sliced_2kb_results[10][10];
-	double decompression_sliced_8kb_results[10][10];
+	PGLZ_StreamState *state = palloc(sizeof(PGLZ_StreamState));
+	PGLZ_StreamDecompressState *decompress_state = palloc(sizeof(PGLZ_StreamDecompressState));
+	char *chunk = palloc(chunk_size);
+	char *compressed = palloc(PGLZ_STREAM_MAX_OUTPUT(chunk_size));
+	char *extracted_data = palloc(chunk_size);
+	char *expected_data = palloc(chunk_size);
+	FILE *f = open_payload(payload);
+	FILE *expected = open_payload(payload);
+	long compressed_size = 0;
+	instr_time compression_time;
+	instr_time decompression_time;
+	instr_time begin;
+	instr_time end;
+	size_t n;
+	int32 size;
 
-	double decompressor_results[10];
+	if (!f || !expected)
+		elog(ERROR, "unable to open payload");
 
-	double compression_results[10][10];
-	double compression_sliced_2kb_results[10][10];
-	double compression_sliced_8kb_results[10][10];
+	INSTR_TIME_SET_ZERO(compression_time);
+	INSTR_TIME_SET_ZERO(decompression_time);
+	pglz_stream_begin(state, PGLZ_strategy_default);
+	pglz_stream_decompress_begin(decompress_state);
 
-	double compressor_results[10];
+	while ((n = fread(chunk, 1, chunk_size, f)) > 0)
+	{
+		INSTR_TIME_SET_CURRENT(begin);
+		size = pglz_stream_feed(state, chunk, n, compressed);
+		INSTR_TIME_SET_CURRENT(end);
+		INSTR_TIME_ACCUM_DIFF(compression_time, end, begin);
+		compressed_size += size;
 
-	int iterations = 5;
-	int iteration;
-	int i,p;
-	int old_verbosity = Log_error_verbosity;
+		stream_decompress_and_check(decompress_state, compressed, size, extracted_data, expected_data,
+									chunk_size, expected, &decompression_time);
+	}
 
-	prepare_payloads();
-	
-	for (p = 0; p < payload_count; p++)
-		for (i = 0; i < decompressors_count; i++)
-		{
-			decompressor_results[i] = 0;
-			decompression_results[p][i] = 0;
-			for (iteration = 0; iteration < iterations; iteration++)
-				decompression_results[p][i] += do_test(0, i, p, true);
-			decompression_results[p][i] /= iterations;
+	INSTR_TIME_SET_CURRENT(begin);
+	size = pglz_stream_finish(state, compressed);
+	INSTR_TIME_SET_CURRENT(end);
+	INSTR_TIME_ACCUM_DIFF(compression_time, end, begin);
+	compressed_size += size;
 
-			decompression_sliced_2kb_results[p][i] = 0;
-			for (iteration = 0; iteration < iterations; iteration++)
-				decompression_sliced_2kb_results[p][i] += do_sliced_test(0, i, p, 2048, true);
-			decompression_sliced_2kb_results[p][i] /= iterations;
-			decompression_results[p][i] /= iterations;
+	stream_decompress_and_check(decompress_state, compressed, size, extracted_data, expected_data,
+								chunk_size, expected, &decompression_time);
+	if (!pglz_stream_decompress_finish(decompress_state) || fgetc(expected) != EOF)
+		elog(ERROR, "decompressed stream is incomplete");
 
-			decompression_sliced_8kb_results[p][i] = 0;
-			for (iteration = 0; iteration < iterations; iteration++)
-				decompression_sliced_8kb_results[p][i] += do_sliced_test(0, i, p, 4096, true);
-			decompression_sliced_8kb_results[p][i] /= iterations;
-		}
+	fclose(f);
+	fclose(expected);
 
-	for (p = 0; p < payload_count; p++)
-		for (i = 0; i < compressors_count; i++)
-		{
-			compressor_results[i] = 0;
-			compression_results[p][i] = 0;
-			for (iteration = 0; iteration < iterations; iteration++)
-				compression_results[p][i] += do_test(i, 0, p, false);
-			compression_results[p][i] /= iterations;
+	*compression_result = INSTR_TIME_GET_DOUBLE(compression_time) * (1000000000.0L / state->raw_size);
+	*decompression_result = INSTR_TIME_GET_DOUBLE(decompression_time) * (1000000000.0L / state->raw_size);
+	*ratio = compressed_size / (double) state->raw_size;
 
-			compression_sliced_2kb_results[p][i] = 0;
-			for (iteration = 0; iteration < iterations; iteration++)
-				compression_sliced_2kb_results[p][i] += do_sliced_test(i, 0, p, 2048, false);
-			compression_sliced_2kb_results[p][i] /= iterations;
-			compression_results[p][i] /= iterations;
+	pfree(state);
+	pfree(decompress_state);
+	pfree(chunk);
+	pfree(compressed);
+	pfree(extracted_data);
+	pfree(expected_data);
+}
 
-			compression_sliced_8kb_results[p][i] = 0;
-			for (iteration = 0; iteration < iterations; iteration++)
-				compression_sliced_8kb_results[p][i] += do_sliced_test(i, 0, p, 4096, false);
-			compression_sliced_8kb_results[p][i] /= iterations;
-		}
+/*
+ * Maps a payload file read-only, or generates a synthetic payload. The
+ * payloads are kept for the rest of the session, so only the first call of
+ * a session pays for them, and their pages are faulted in up front instead
+ * of inside the first test.
+ */
+static void prepare_payload(int i)
+{
+	FILE *f;
+	struct stat st;
+	void *data;
 
-	Log_error_verbosity = PGERROR_TERSE;
-	ereport(NOTICE, (errmsg("Time to decompress one byte in ns:"), errhidestmt(true)));
-	for (p = 0; p < payload_count; p++)
+	if (payloads == NULL)
 	{
-		ereport(NOTICE, (errmsg("Payload %s", payload_names[p]), errhidestmt(true)));
-		for (i = 1; i < decompressors_count; i++)
-		{
-			ereport(NOTICE, (errmsg("Decompressor %s result %f", decompressor_name[i], decompression_results[p][i]), errhidestmt(true)));
-			decompressor_results[i] += decompression_results[p][i];
-		}
+		payloads = MemoryContextAllocZero(TopMemoryContext, sizeof(void*) * payload_count);
+		payload_sizes = MemoryContextAllocZero(TopMemoryContext, sizeof(long) * payload_count);
+	}
 
-		ereport(NOTICE, (errmsg("Payload %s sliced by 2Kb", payload_names[p]), errhidestmt(true)));
-		for (i = 1; i < decompressors_count; i++)
+	if (payloads[i] == NULL && i >= payload_file_count)
+	{
+		data = MemoryContextAlloc(TopMemoryContext, PGLZ_ADVERSARY_SIZE);
+		pglz_adversaries[i - payload_file_count].generate(data, PGLZ_ADVERSARY_SIZE);
+		payloads[i] = data;
+		payload_sizes[i] = PGLZ_ADVERSARY_SIZE;
+	}
+	else if (payloads[i] == NULL)
+	{
+		f = open_payload(i);
+		if (!f)
+			elog(ERROR, "unable to open payload");
+		if (fstat(fileno(f), &st) != 0 || st.st_size == 0)
 		{
-			ereport(NOTICE, (errmsg("Decompressor %s result %f", decompressor_name[i], decompression_results[p][i]), errhidestmt(true)));
-			decompressor_results[i] += decompression_sliced_2kb_results[p][i];
+			fclose(f);
+			elog(ERROR, "unable to read payload");
 		}
 
-		ereport(NOTICE, (errmsg("Payload %s sliced by 8Kb", payload_names[p]), errhidestmt(true)));
-		for (i = 1; i < decompressors_count; i++)
-		{
-			ereport(NOTICE, (errmsg("Decompressor %s result %f", decompressor_name[i], decompression_sliced_8kb_results[p][i]), errhidestmt(true)));
-			decompressor_results[i] += decompression_sliced_8kb_results[p][i];
-		}
+#ifdef MAP_POPULATE
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fileno(f), 0);
+#else
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+#endif
+		fclose(f);
+		if (data == MAP_FAILED)
+			elog(ERROR, "unable to map payload");
+#ifdef MADV_WILLNEED
+		madvise(data, st.st_size, MADV_WILLNEED);
+#endif
+		payloads[i] = data;
+		payload_sizes[i] = st.st_size;
 	}
+}
+
+static void prepare_payloads()
+{
+	int i;
 
-	ereport(NOTICE, (errmsg("\n\nDecompressor score (summ of all times):"), errhidestmt(true)));
-	for (i = 1; i < decompressors_count; i++)
+	for (i=0; i< payload_count; i++)
+		prepare_payload(i);
+}
+
+/*
+ * Adds one result row of test_pglz() to the tuple store.  The time per byte
+ * is the median of the iterations.  Negative rejected, setup and hardware
+ * counter figures are NULL.
+ */
+static void put_result(Tuplestorestate *tupstore, TupleDesc tupdesc, int payload, const char *codec,
+					   const char *direction, int slice_size, bench_stats *stats, double ratio,
+					   double rejected_share, double rejected_ns_per_byte, double setup_ns_per_datum)
+{
+	Datum values[18];
+	bool nulls[18] = {false};
+	double perf[5] = {stats->cycles_per_byte, stats->ipc, stats->branch_misses_per_byte,
+					  stats->l1d_misses_per_byte, stats->llc_misses_per_byte};
+	int i;
+
+	values[0] = CStringGetTextDatum(payload_names[payload]);
+	values[1] = CStringGetTextDatum(codec);
+	values[2] = CStringGetTextDatum(direction);
+	values[3] = Int32GetDatum(slice_size);
+	values[4] = Float8GetDatum(stats->median);
+	values[5] = Float8GetDatum(1000.0 / stats->median);
+	values[6] = Float8GetDatum(ratio);
+	values[7] = Float8GetDatum(stats->min);
+	values[8] = Float8GetDatum(stats->p99);
+	values[9] = Float8GetDatum(stats->stddev);
+	values[10] = Float8GetDatum(rejected_share);
+	nulls[10] = rejected_share < 0;
+	values[11] = Float8GetDatum(rejected_ns_per_byte);
+	nulls[11] = rejected_ns_per_byte < 0;
+	values[12] = Float8GetDatum(setup_ns_per_datum);
+	nulls[12] = setup_ns_per_datum < 0;
+	for (i = 0; i < 5; i++)
 	{
-		ereport(NOTICE, (errmsg("Decompressor %s result %f", decompressor_name[i], decompressor_results[i]), errhidestmt(true)));
+		values[13 + i] = Float8GetDatum(perf[i]);
+		nulls[13 + i] = perf[i] < 0;
 	}
 
-	Log_error_verbosity = PGERROR_TERSE;
-	ereport(NOTICE, (errmsg("Time to compress one byte in ns:"), errhidestmt(true)));
-	for (p = 0; p < payload_count; p++)
+	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+}
+
+static int find_name(char **names, int first, int count, const char *name)
+{
+	int i;
+
+	for (i = first; i < count; i++)
+		if (strcmp(names[i], name) == 0)
+			return i;
+	return -1;
+}
+
+/*
+ * Marks the payloads listed in a text array argument. Besides payload names
+ * the array may hold the categories "corpus", standing for all payload
+ * files, and "adversary", standing for all generated payloads. A NULL
+ * argument selects all payloads.
+ */
+static void select_payloads(FunctionCallInfo fcinfo, int arg, bool *selected)
+{
+	Datum *elems;
+	bool *elem_nulls;
+	int nelems;
+	int i, p;
+
+	if (PG_ARGISNULL(arg))
 	{
-		ereport(NOTICE, (errmsg("Payload %s", payload_names[p]), errhidestmt(true)));
-		for (i = 0; i < compressors_count; i++)
-		{
-			ereport(NOTICE, (errmsg("Compressor %s result %f", compressor_name[i], compression_results[p][i]), errhidestmt(true)));
-			compressor_results[i] += compression_results[p][i];
-		}
+		for (p = 0; p < payload_count; p++)
+			selected[p] = true;
+		return;
+	}
+
+	deconstruct_array(PG_GETARG_ARRAYTYPE_P(arg), TEXTOID, -1, false, 'i', &elems, &elem_nulls, &nelems);
+	for (i = 0; i < nelems; i++)
+	{
+		char *name;
+		int found;
 
-		ereport(NOTICE, (errmsg("Payload %s sliced by 2Kb", payload_names[p]), errhidestmt(true)));
-		for (i = 0; i < compressors_count; i++)
+		if (elem_nulls[i])
+			continue;
+		name = TextDatumGetCString(elems[i]);
+		if (strcmp(name, "corpus") == 0)
 		{
-			ereport(NOTICE, (errmsg("Compressor %s result %f", compressor_name[i], compression_results[p][i]), errhidestmt(true)));
-			compressor_results[i] += compression_sliced_2kb_results[p][i];
+			for (p = 0; p < payload_file_count; p++)
+				selected[p] = true;
+			continue;
 		}
-
-		ereport(NOTICE, (errmsg("Payload %s sliced by 8Kb", payload_names[p]), errhidestmt(true)));
-		for (i = 0; i < compressors_count; i++)
+		if (strcmp(name, "adversary") == 0)
 		{
-			ereport(NOTICE, (errmsg("Compressor %s result %f", compressor_name[i], compression_sliced_8kb_results[p][i]), errhidestmt(true)));
-			compressor_results[i] += compression_sliced_8kb_results[p][i];
+			for (p = payload_file_count; p < payload_count; p++)
+				selected[p] = true;
+			continue;
 		}
+		found = find_name(payload_names, 0, payload_count, name);
+		if (found == -1)
+			elog(ERROR, "unknown payload \"%s\"", name);
+		selected[found] = true;
+	}
+}
+
+/*
+ * Reads the slice sizes from an integer array argument, 0 standing for the
+ * whole payload. A NULL argument selects the whole payload, 2Kb and 8Kb
+ * slices. Returns the number of sizes.
+ */
+static int get_slice_sizes(FunctionCallInfo fcinfo, int arg, int **slice_sizes)
+{
+	static int default_slice_sizes[] = {0, 2048, 8192};
+	Datum *elems;
+	bool *elem_nulls;
+	int slice_count;
+	int s;
+
+	if (PG_ARGISNULL(arg))
+	{
+		*slice_sizes = default_slice_sizes;
+		return lengthof(default_slice_sizes);
 	}
 
-	ereport(NOTICE, (errmsg("\n\nCompressor score (summ of all times):"), errhidestmt(true)));
-	for (i = 0; i < compressors_count; i++)
+	deconstruct_array(PG_GETARG_ARRAYTYPE_P(arg), INT4OID, sizeof(int32), true, 'i', &elems, &elem_nulls, &slice_count);
+	*slice_sizes = palloc(slice_count * sizeof(int));
+	for (s = 0; s < slice_count; s++)
 	{
-		ereport(NOTICE, (errmsg("Compressor %s result %f", compressor_name[i], compressor_results[i]), errhidestmt(true)));
+		if (elem_nulls[s] || DatumGetInt32(elems[s]) < 0)
+			elog(ERROR, "slice sizes must not be negative");
+		(*slice_sizes)[s] = DatumGetInt32(elems[s]);
+	}
+	return slice_count;
+}
+
+/*
+ * Checks that the caller accepts a materialized set and starts one. Returns
+ * the tuplestore for the rows and their type in *tupdesc.
+ */
+static Tuplestorestate *begin_materialize(FunctionCallInfo fcinfo, TupleDesc *tupdesc)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		elog(ERROR, "set-valued function called in context that cannot accept a set");
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		elog(ERROR, "materialize mode required, but it is not allowed in this context");
+	if (get_call_result_type(fcinfo, NULL, tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = *tupdesc;
+	MemoryContextSwitchTo(oldcontext);
+
+	return tupstore;
+}
+
+/* Adds the rows for one payload and slice size, see materialize_slices() */
+typedef void (*slice_test) (Tuplestorestate *tupstore, TupleDesc tupdesc, int payload, int slice_size, void *arg);
+
+/*
+ * Body of the SRFs that take payloads as argument 0 and slice sizes as
+ * argument 1: runs test with arg on every selected payload and slice size,
+ * skipping slice sizes bigger than the payload, and returns the rows.
+ */
+static Datum materialize_slices(FunctionCallInfo fcinfo, slice_test test, void *arg)
+{
+	bool *use_payload = palloc0(payload_count * sizeof(bool));
+	int *slice_sizes;
+	int slice_count;
+	TupleDesc tupdesc;
+	Tuplestorestate *tupstore;
+	int p, s;
+
+	tupstore = begin_materialize(fcinfo, &tupdesc);
+	select_payloads(fcinfo, 0, use_payload);
+	slice_count = get_slice_sizes(fcinfo, 1, &slice_sizes);
+
+	for (p = 0; p < payload_count; p++)
+	{
+		if (!use_payload[p])
+			continue;
+		prepare_payload(p);
+
+		for (s = 0; s < slice_count; s++)
+		{
+			/* too big to make a single slice */
+			if (slice_sizes[s] > payload_sizes[p])
+				continue;
+			CHECK_FOR_INTERRUPTS();
+			test(tupstore, tupdesc, p, slice_sizes[s], arg);
+		}
+	}
+
+	pfree(use_payload);
+
+	return (Datum) 0;
+}
+
+/*
+ * SQL-callable entry point to perform the tests. codecs and payloads name
+ * the compressors, decompressors and payloads to test, NULL meaning all of
+ * them; every codec is tested on every slice size, 0 standing for the whole
+ * payload. Returns one row per payload, codec, direction and slice size.
+ * Decompressors are fed by the vanilla compressor, so their ratio is that
+ * of pglz_compress_vanilla. With perf the rows also carry hardware counters
+ * of the timed iterations.
+ */
+Datum
+test_pglz(PG_FUNCTION_ARGS)
+{
+	int iterations = PG_ARGISNULL(3) ? 5 : PG_GETARG_INT32(3);
+	int warmup = PG_ARGISNULL(4) ? 1 : PG_GETARG_INT32(4);
+	bool perf = PG_ARGISNULL(5) ? false : PG_GETARG_BOOL(5);
+	int *slice_sizes;
+	int slice_count;
+	bool *use_compressor = palloc0(pglz_compressors_count * sizeof(bool));
+	bool *use_decompressor = palloc0(pglz_decompressors_count * sizeof(bool));
+	bool *use_payload = palloc0(payload_count * sizeof(bool));
+	TupleDesc tupdesc;
+	Tuplestorestate *tupstore;
+	bench_stats stats;
+	int i,p,s;
+
+	tupstore = begin_materialize(fcinfo, &tupdesc);
+	if (iterations < 1)
+		elog(ERROR, "number of iterations must be positive");
+	if (warmup < 0)
+		elog(ERROR, "number of warmup iterations must not be negative");
+
+	if (PG_ARGISNULL(0))
+	{
+		/* all codecs this CPU can run */
+		for (i = 0; i < pglz_compressors_count; i++)
+			use_compressor[i] = pglz_codec_usable(&pglz_compressors[i]);
+		for (i = 0; i < pglz_decompressors_count; i++)
+			use_decompressor[i] = pglz_codec_usable(&pglz_decompressors[i]);
+	}
+	else
+	{
+		Datum *elems;
+		bool *elem_nulls;
+		int nelems;
+
+		deconstruct_array(PG_GETARG_ARRAYTYPE_P(0), TEXTOID, -1, false, 'i', &elems, &elem_nulls, &nelems);
+		for (i = 0; i < nelems; i++)
+		{
+			char *name;
+			const PGLZ_Codec *codec;
+
+			if (elem_nulls[i])
+				continue;
+			name = TextDatumGetCString(elems[i]);
+			if ((codec = pglz_find_codec(pglz_compressors, pglz_compressors_count, name)) != NULL)
+				use_compressor[codec - pglz_compressors] = true;
+			else if ((codec = pglz_find_codec(pglz_decompressors, pglz_decompressors_count, name)) != NULL)
+				use_decompressor[codec - pglz_decompressors] = true;
+			else
+				elog(ERROR, "unknown codec \"%s\"", name);
+			if (!pglz_codec_usable(codec))
+				elog(ERROR, "codec \"%s\" needs CPU features this machine does not have", name);
+		}
+	}
+
+	select_payloads(fcinfo, 1, use_payload);
+
+	slice_count = get_slice_sizes(fcinfo, 2, &slice_sizes);
+
+	for (p = 0; p < payload_count; p++)
+	{
+		if (!use_payload[p])
+			continue;
+		prepare_payload(p);
+
+		for (s = 0; s < slice_count; s++)
+		{
+			double vanilla_ratio;
+			double rejected_share;
+			double rejected_ns_per_byte;
+
+			/* too big to make a single slice */
+			if (slice_sizes[s] > payload_sizes[p])
+				continue;
+			vanilla_ratio = do_ratio_test(0, p, slice_sizes[s], &rejected_share, &rejected_ns_per_byte);
+
+			for (i = 0; i < pglz_decompressors_count; i++)
+			{
+				if (!use_decompressor[i])
+					continue;
+				do_benchmark(0, i, p, slice_sizes[s], true, warmup, iterations, perf, &stats);
+				put_result(tupstore, tupdesc, p, pglz_decompressors[i].name, "decompression",
+						   slice_sizes[s], &stats, vanilla_ratio, -1, -1, -1);
+			}
+
+			for (i = 0; i < pglz_compressors_count; i++)
+			{
+				double ratio;
+				double setup_ns_per_datum = -1;
+
+				if (!use_compressor[i])
+					continue;
+				do_benchmark(i, 0, p, slice_sizes[s], false, warmup, iterations, perf, &stats);
+				ratio = do_ratio_test(i, p, slice_sizes[s], &rejected_share, &rejected_ns_per_byte);
+				if (slice_sizes[s] > 0)
+					setup_ns_per_datum = do_setup_test(i, p, slice_sizes[s]);
+				put_result(tupstore, tupdesc, p, pglz_compressors[i].name, "compression",
+						   slice_sizes[s], &stats, ratio, rejected_share, rejected_ns_per_byte,
+						   setup_ns_per_datum);
+			}
+		}
+	}
+
+	return (Datum) 0;
+}
+
+
+/*
+ * Cross-checks every usable compressor with every usable decompressor on
+ * the slices of one payload, and adds a row per pair with the number of
+ * slices and of failures.
+ */
+static void verify_payload(Tuplestorestate *tupstore, TupleDesc tupdesc, int payload, int slice_size, void *arg)
+{
+	char *data = payloads[payload];
+	long size = payload_sizes[payload];
+	int pairs = pglz_compressors_count * pglz_decompressors_count;
+	int *failures = palloc0(pairs * sizeof(int));
+	const char **first_failure = palloc0(pairs * sizeof(char *));
+	int slice_len = slice_size ? slice_size : size;
+	char *compressed;
+	int slices = 0;
+	long offset;
+	int c, d;
+
+	compressed = palloc(PGLZ_VERIFY_COMPRESS_SPACE(slice_len));
+
+	for (offset = 0; offset + slice_len <= size; offset += slice_len)
+	{
+		slices++;
+		for (c = 0; c < pglz_compressors_count; c++)
+		{
+			const char *compress_failure;
+			int32 comp_size;
+
+			if (!pglz_codec_usable(&pglz_compressors[c]))
+				continue;
+			compress_failure = pglz_verify_compress(&pglz_compressors[c], data + offset, slice_len, compressed, &comp_size);
+
+			for (d = 0; d < pglz_decompressors_count; d++)
+			{
+				const char *failure = compress_failure;
+				int pair = c * pglz_decompressors_count + d;
+
+				if (!pglz_codec_usable(&pglz_decompressors[d]))
+					continue;
+				if (failure == NULL && comp_size != -1)
+					failure = pglz_verify_decompress(&pglz_decompressors[d], compressed, comp_size, data + offset, slice_len);
+				if (failure == NULL)
+					continue;
+				if (failures[pair]++ == 0)
+					first_failure[pair] = failure;
+			}
+		}
+	}
+
+	for (c = 0; c < pglz_compressors_count; c++)
+	{
+		if (!pglz_codec_usable(&pglz_compressors[c]))
+			continue;
+		for (d = 0; d < pglz_decompressors_count; d++)
+		{
+			int pair = c * pglz_decompressors_count + d;
+			Datum values[7];
+			bool nulls[7] = {false};
+
+			if (!pglz_codec_usable(&pglz_decompressors[d]))
+				continue;
+			values[0] = CStringGetTextDatum(payload_names[payload]);
+			values[1] = CStringGetTextDatum(pglz_compressors[c].name);
+			values[2] = CStringGetTextDatum(pglz_decompressors[d].name);
+			values[3] = Int32GetDatum(slice_size);
+			values[4] = Int32GetDatum(slices);
+			values[5] = Int32GetDatum(failures[pair]);
+			if (first_failure[pair] != NULL)
+				values[6] = CStringGetTextDatum(first_failure[pair]);
+			else
+				nulls[6] = true;
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		}
+	}
+
+	pfree(compressed);
+	pfree(failures);
+	pfree(first_failure);
+}
+
+/*
+ * SQL-callable entry point to verify all codecs against the vanilla ones
+ * on the given payloads and slice sizes. Returns one row per payload,
+ * codec pair and slice size; any row with failures means a broken codec.
+ */
+Datum
+test_pglz_verify(PG_FUNCTION_ARGS)
+{
+	return materialize_slices(fcinfo, verify_payload, NULL);
+}
+
+
+/*
+ * Extracts ranges of range_size bytes, spread evenly over the payload, once
+ * from a plain pglz stream of the whole payload, which has to be decoded up
+ * to the end of each range, and once from a block-indexed container. Adds a
+ * row with both ratios and the mean time per range in microseconds.
+ */
+static void range_payload(Tuplestorestate *tupstore, TupleDesc tupdesc, int payload, int block_size,
+						  int range_size, int ranges)
+{
+	char *data = payloads[payload];
+	long size = payload_sizes[payload];
+	char *plain = palloc(PGLZ_MAX_OUTPUT(size));
+	char *container = palloc(PGLZ_BLOCKS_MAX_OUTPUT(size, block_size));
+	char *prefix = palloc(size);
+	char *extracted = palloc(range_size);
+	int32 plain_size;
+	int32 container_size;
+	instr_time plain_time;
+	instr_time range_time;
+	instr_time begin;
+	instr_time end;
+	Datum values[8];
+	bool nulls[8] = {false};
+	int k;
+
+	/* a payload that does not compress is stored raw, as TOAST would */
+	plain_size = pglz_compress_hacked(data, size, plain, PGLZ_strategy_always);
+	container_size = pglz_compress_blocks(data, size, container, block_size, PGLZ_strategy_always);
+
+	INSTR_TIME_SET_ZERO(plain_time);
+	INSTR_TIME_SET_ZERO(range_time);
+	for (k = 0; k < ranges; k++)
+	{
+		int32 offset = ranges == 1 ? 0 : (size - range_size) * k / (ranges - 1);
+		int32 result;
+
+		INSTR_TIME_SET_CURRENT(begin);
+		if (plain_size < 0)
+		{
+			memcpy(prefix + offset, data + offset, range_size);
+			result = offset + range_size;
+		}
+		else
+			result = pglz_decompress_hacked(plain, plain_size, prefix, offset + range_size, false);
+		INSTR_TIME_SET_CURRENT(end);
+		INSTR_TIME_ACCUM_DIFF(plain_time, end, begin);
+		if (result != offset + range_size || memcmp(prefix + offset, data + offset, range_size) != 0)
+			elog(ERROR, "prefix decompression of payload %s is wrong", payload_names[payload]);
+
+		INSTR_TIME_SET_CURRENT(begin);
+		result = pglz_decompress_range(container, container_size, extracted, offset, range_size,
+									   pglz_decompress_hacked);
+		INSTR_TIME_SET_CURRENT(end);
+		INSTR_TIME_ACCUM_DIFF(range_time, end, begin);
+		if (result != range_size || memcmp(extracted, data + offset, range_size) != 0)
+			elog(ERROR, "range decompression of payload %s is wrong", payload_names[payload]);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	values[0] = CStringGetTextDatum(payload_names[payload]);
+	values[1] = Int32GetDatum(block_size);
+	values[2] = Int32GetDatum(range_size);
+	values[3] = Float8GetDatum(plain_size < 0 ? 1.0 : plain_size / (double) size);
+	values[4] = Float8GetDatum(container_size / (double) size);
+	values[5] = Float8GetDatum(INSTR_TIME_GET_DOUBLE(plain_time) * 1000000.0 / ranges);
+	values[6] = Float8GetDatum(INSTR_TIME_GET_DOUBLE(range_time) * 1000000.0 / ranges);
+	values[7] = Float8GetDatum(INSTR_TIME_GET_DOUBLE(plain_time) / INSTR_TIME_GET_DOUBLE(range_time));
+	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+
+	pfree(plain);
+	pfree(container);
+	pfree(prefix);
+	pfree(extracted);
+}
+
+/*
+ * SQL-callable entry point to compare substring extraction from plain
+ * streams and from block-indexed containers. Returns a row per payload at
+ * least range_size bytes big.
+ */
+Datum
+test_pglz_range(PG_FUNCTION_ARGS)
+{
+	bool *use_payload = palloc0(payload_count * sizeof(bool));
+	int block_size = PG_GETARG_INT32(1);
+	int range_size = PG_GETARG_INT32(2);
+	int ranges = PG_GETARG_INT32(3);
+	TupleDesc tupdesc;
+	Tuplestorestate *tupstore;
+	int p;
+
+	tupstore = begin_materialize(fcinfo, &tupdesc);
+	if (block_size < 1 || range_size < 1 || ranges < 1)
+		elog(ERROR, "block size, range size and number of ranges must be positive");
+
+	select_payloads(fcinfo, 0, use_payload);
+
+	for (p = 0; p < payload_count; p++)
+	{
+		if (!use_payload[p])
+			continue;
+		prepare_payload(p);
+		if (range_size > payload_sizes[p])
+			continue;
+		range_payload(tupstore, tupdesc, p, block_size, range_size, ranges);
+	}
+
+	return (Datum) 0;
+}
+
+/*
+ * Trains a dictionary on every training_stride-th slice of the payload and
+ * compresses the other slices without and with it. Adds a row with both
+ * ratios and times in ns per byte, decompression counting only the slices
+ * that compressed.
+ */
+static void dict_payload(Tuplestorestate *tupstore, TupleDesc tupdesc, int payload, int slice_size,
+						 int dict_size, int training_stride)
+{
+	char *data = payloads[payload];
+	long size = payload_sizes[payload];
+	int slice_count = size / slice_size;
+	int32 *sample_sizes = palloc(((slice_count + training_stride - 1) / training_stride) * sizeof(int32));
+	char *samples = palloc((Size) slice_size * ((slice_count + training_stride - 1) / training_stride));
+	PGLZ_Dictionary *dict = palloc(sizeof(PGLZ_Dictionary));
+	char *compressed = palloc(PGLZ_MAX_OUTPUT(slice_size));
+	char *extracted = palloc(slice_size);
+	instr_time times[5];
+	instr_time begin;
+	instr_time end;
+	long totals[2] = {0, 0};
+	long tested = 0;
+	int nsamples = 0;
+	Datum values[10];
+	bool nulls[10] = {false};
+	int i, k;
+
+	for (k = 0; k < 5; k++)
+		INSTR_TIME_SET_ZERO(times[k]);
+
+	for (i = 0; i < slice_count; i += training_stride)
+	{
+		memcpy(samples + (Size) slice_size * nsamples, data + (Size) slice_size * i, slice_size);
+		sample_sizes[nsamples++] = slice_size;
+	}
+	INSTR_TIME_SET_CURRENT(begin);
+	pglz_dict_train(dict, samples, sample_sizes, nsamples, dict_size);
+	INSTR_TIME_SET_CURRENT(end);
+	INSTR_TIME_ACCUM_DIFF(times[4], end, begin);
+
+	for (i = 0; i < slice_count; i++)
+	{
+		const char *slice = data + (Size) slice_size * i;
+
+		if (i % training_stride == 0)
+			continue;
+		tested += slice_size;
+
+		/* k is 0 for plain compression and 1 for the dictionary */
+		for (k = 0; k < 2; k++)
+		{
+			int32 comp_size;
+			int32 result;
+
+			INSTR_TIME_SET_CURRENT(begin);
+			if (k == 0)
+				comp_size = pglz_compress_hacked(slice, slice_size, compressed, PGLZ_strategy_default);
+			else
+				comp_size = pglz_compress_dict(dict, slice, slice_size, compressed, PGLZ_strategy_default);
+			INSTR_TIME_SET_CURRENT(end);
+			INSTR_TIME_ACCUM_DIFF(times[k], end, begin);
+			totals[k] += comp_size == -1 ? slice_size : comp_size;
+			if (comp_size == -1)
+				continue;
+
+			INSTR_TIME_SET_CURRENT(begin);
+			if (k == 0)
+				result = pglz_decompress_hacked(compressed, comp_size, extracted, slice_size, true);
+			else
+				result = pglz_decompress_dict(dict, compressed, comp_size, extracted, slice_size, true);
+			INSTR_TIME_SET_CURRENT(end);
+			INSTR_TIME_ACCUM_DIFF(times[2 + k], end, begin);
+			if (result != slice_size || memcmp(extracted, slice, slice_size) != 0)
+				elog(ERROR, "decompression of payload %s is wrong", payload_names[payload]);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	values[0] = CStringGetTextDatum(payload_names[payload]);
+	values[1] = Int32GetDatum(slice_size);
+	values[2] = Int32GetDatum(dict->size);
+	values[3] = Float8GetDatum(totals[0] / (double) tested);
+	values[4] = Float8GetDatum(totals[1] / (double) tested);
+	for (k = 0; k < 4; k++)
+		values[5 + k] = Float8GetDatum(INSTR_TIME_GET_DOUBLE(times[k]) * 1000000000.0 / tested);
+	values[9] = Float8GetDatum(INSTR_TIME_GET_DOUBLE(times[4]) * 1000.0);
+	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+
+	pfree(sample_sizes);
+	pfree(samples);
+	pfree(dict);
+	pfree(compressed);
+	pfree(extracted);
+}
+
+/*
+ * SQL-callable entry point to see what a trained dictionary does for small
+ * slices. Returns a row per payload with at least two slices.
+ */
+Datum
+test_pglz_dict(PG_FUNCTION_ARGS)
+{
+	bool *use_payload = palloc0(payload_count * sizeof(bool));
+	int slice_size = PG_GETARG_INT32(1);
+	int dict_size = PG_GETARG_INT32(2);
+	int training_stride = PG_GETARG_INT32(3);
+	TupleDesc tupdesc;
+	Tuplestorestate *tupstore;
+	int p;
+
+	tupstore = begin_materialize(fcinfo, &tupdesc);
+	if (slice_size < 1 || training_stride < 2)
+		elog(ERROR, "slice size must be positive and training stride at least 2");
+	if (dict_size < 0 || dict_size > PGLZ_DICT_MAX_SIZE)
+		elog(ERROR, "dictionary size must be between 0 and %d", PGLZ_DICT_MAX_SIZE);
+
+	select_payloads(fcinfo, 0, use_payload);
+
+	for (p = 0; p < payload_count; p++)
+	{
+		if (!use_payload[p])
+			continue;
+		prepare_payload(p);
+		if (payload_sizes[p] / slice_size < 2)
+			continue;
+		dict_payload(tupstore, tupdesc, p, slice_size, dict_size, training_stride);
+	}
+
+	return (Datum) 0;
+}
+
+/*
+ * Compresses the payload in slices of slice_size, 0 standing for the whole
+ * payload, with pglz_compress_hacked and with pglz2_compress. Adds a row
+ * with both ratios and times in ns per byte, decompression counting only
+ * the slices that compressed.
+ */
+static void pglz2_payload(Tuplestorestate *tupstore, TupleDesc tupdesc, int payload, int slice_size, void *arg)
+{
+	char *data = payloads[payload];
+	long size = payload_sizes[payload];
+	int slice_count;
+	char *compressed;
+	char *extracted;
+	instr_time times[4];
+	instr_time begin;
+	instr_time end;
+	long totals[2] = {0, 0};
+	long tested;
+	Datum values[8];
+	bool nulls[8] = {false};
+	int i, k;
+
+	if (slice_size == 0)
+		slice_size = size;
+	slice_count = size / slice_size;
+	tested = (long) slice_size * slice_count;
+	compressed = palloc(PGLZ2_MAX_OUTPUT(slice_size));
+	extracted = palloc(slice_size);
+
+	for (k = 0; k < 4; k++)
+		INSTR_TIME_SET_ZERO(times[k]);
+
+	for (i = 0; i < slice_count; i++)
+	{
+		const char *slice = data + (Size) slice_size * i;
+
+		/* k is 0 for pglz and 1 for pglz2 */
+		for (k = 0; k < 2; k++)
+		{
+			int32 comp_size;
+			int32 result;
+
+			INSTR_TIME_SET_CURRENT(begin);
+			if (k == 0)
+				comp_size = pglz_compress_hacked(slice, slice_size, compressed, PGLZ_strategy_default);
+			else
+				comp_size = pglz2_compress(slice, slice_size, compressed, PGLZ_strategy_default);
+			INSTR_TIME_SET_CURRENT(end);
+			INSTR_TIME_ACCUM_DIFF(times[k], end, begin);
+			totals[k] += comp_size == -1 ? slice_size : comp_size;
+			if (comp_size == -1)
+				continue;
+
+			INSTR_TIME_SET_CURRENT(begin);
+			if (k == 0)
+				result = pglz_decompress_hacked(compressed, comp_size, extracted, slice_size, true);
+			else
+				result = pglz2_decompress(compressed, comp_size, extracted, slice_size, true);
+			INSTR_TIME_SET_CURRENT(end);
+			INSTR_TIME_ACCUM_DIFF(times[2 + k], end, begin);
+			if (result != slice_size || memcmp(extracted, slice, slice_size) != 0)
+				elog(ERROR, "decompression of payload %s is wrong", payload_names[payload]);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	values[0] = CStringGetTextDatum(payload_names[payload]);
+	values[1] = Int32GetDatum(slice_size);
+	values[2] = Float8GetDatum(totals[0] / (double) tested);
+	values[3] = Float8GetDatum(totals[1] / (double) tested);
+	for (k = 0; k < 4; k++)
+		values[4 + k] = Float8GetDatum(INSTR_TIME_GET_DOUBLE(times[k]) * 1000000000.0 / tested);
+	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+
+	pfree(compressed);
+	pfree(extracted);
+}
+
+/*
+ * SQL-callable entry point to compare the pglz2 variant with classic pglz
+ * on the given payloads and slice sizes. Returns one row per payload and
+ * slice size.
+ */
+Datum
+test_pglz2(PG_FUNCTION_ARGS)
+{
+	return materialize_slices(fcinfo, pglz2_payload, NULL);
+}
+
+/* Distance of the segments of test_pglz_scatter(), like pages of a table */
+#define SCATTER_PAGE_SIZE 8192
+
+/*
+ * Compares the round trip through a temporary buffer with one straight
+ * from and to the final places: pglz_compress_bounded() into a slot of
+ * slice_size bytes and pglz_decompress_scatter() into segments of the size
+ * arg points to, each on a page of its own.
+ */
+static void scatter_payload(Tuplestorestate *tupstore, TupleDesc tupdesc, int payload, int slice_size,
+							void *arg)
+{
+	int segment_size = *(int *) arg;
+	char *data = payloads[payload];
+	long size = payload_sizes[payload];
+	int slice_count;
+	int segment_count;
+	char *temp;
+	char *slot;
+	char *pages;
+	PGLZ_Segment *segments;
+	instr_time times[4];
+	instr_time begin;
+	instr_time end;
+	long tested = 0;
+	Datum values[7];
+	bool nulls[7] = {false};
+	int i, k;
+
+	if (slice_size == 0)
+		slice_size = size;
+	slice_count = size / slice_size;
+	segment_count = (slice_size + segment_size - 1) / segment_size;
+	temp = palloc(PGLZ_MAX_OUTPUT(slice_size));
+	slot = palloc(slice_size);
+	pages = palloc((Size) segment_count * SCATTER_PAGE_SIZE);
+	segments = palloc(segment_count * sizeof(PGLZ_Segment));
+	for (k = 0; k < segment_count; k++)
+	{
+		segments[k].data = pages + (Size) k * SCATTER_PAGE_SIZE;
+		segments[k].len = Min(segment_size, slice_size - k * segment_size);
+	}
+
+	for (k = 0; k < 4; k++)
+		INSTR_TIME_SET_ZERO(times[k]);
+
+	for (i = 0; i < slice_count; i++)
+	{
+		const char *slice = data + (Size) slice_size * i;
+		int32 comp_size;
+		int32 result;
+
+		/* through a buffer of the worst case size */
+		INSTR_TIME_SET_CURRENT(begin);
+		comp_size = pglz_compress_hacked(slice, slice_size, temp, PGLZ_strategy_default);
+		if (comp_size != -1)
+			memcpy(slot, temp, comp_size);
+		INSTR_TIME_SET_CURRENT(end);
+		INSTR_TIME_ACCUM_DIFF(times[0], end, begin);
+
+		INSTR_TIME_SET_CURRENT(begin);
+		comp_size = pglz_compress_bounded(slice, slice_size, slot, slice_size, PGLZ_strategy_default);
+		INSTR_TIME_SET_CURRENT(end);
+		INSTR_TIME_ACCUM_DIFF(times[1], end, begin);
+
+		/* like the other benchmarks, only slices that compressed count */
+		if (comp_size == -1)
+			continue;
+		tested += slice_size;
+
+		INSTR_TIME_SET_CURRENT(begin);
+		result = pglz_decompress_hacked(slot, comp_size, temp, slice_size, true);
+		for (k = 0; k < segment_count; k++)
+			memcpy(segments[k].data, temp + (Size) k * segment_size, segments[k].len);
+		INSTR_TIME_SET_CURRENT(end);
+		INSTR_TIME_ACCUM_DIFF(times[2], end, begin);
+		if (result != slice_size || memcmp(temp, slice, slice_size) != 0)
+			elog(ERROR, "decompression of payload %s is wrong", payload_names[payload]);
+
+		memset(pages, 0, (Size) segment_count * SCATTER_PAGE_SIZE);
+		INSTR_TIME_SET_CURRENT(begin);
+		result = pglz_decompress_scatter(slot, comp_size, segments, segment_count, true);
+		INSTR_TIME_SET_CURRENT(end);
+		INSTR_TIME_ACCUM_DIFF(times[3], end, begin);
+		if (result != slice_size)
+			elog(ERROR, "scatter decompression of payload %s is wrong", payload_names[payload]);
+		for (k = 0; k < segment_count; k++)
+			if (memcmp(segments[k].data, slice + (Size) k * segment_size, segments[k].len) != 0)
+				elog(ERROR, "scatter decompression of payload %s is wrong", payload_names[payload]);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	values[0] = CStringGetTextDatum(payload_names[payload]);
+	values[1] = Int32GetDatum(slice_size);
+	values[2] = Int32GetDatum(segment_size);
+	for (k = 0; k < 4; k++)
+	{
+		/* compression per byte of payload, decompression per byte decompressed */
+		double bytes = k < 2 ? (double) slice_size * slice_count : tested;
+
+		values[3 + k] = Float8GetDatum(INSTR_TIME_GET_DOUBLE(times[k]) * 1000000000.0 / bytes);
+		nulls[3 + k] = bytes == 0;
+	}
+	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+
+	pfree(temp);
+	pfree(slot);
+	pfree(pages);
+	pfree(segments);
+}
+
+/*
+ * SQL-callable entry point to see what compressing into the final slot and
+ * decompressing into scattered segments save over going through temporary
+ * buffers. Returns one row per payload and slice size.
+ */
+Datum
+test_pglz_scatter(PG_FUNCTION_ARGS)
+{
+	int segment_size = PG_GETARG_INT32(2);
+
+	if (segment_size < 1 || segment_size > SCATTER_PAGE_SIZE)
+		elog(ERROR, "segment size must be between 1 and %d", SCATTER_PAGE_SIZE);
+
+	return materialize_slices(fcinfo, scatter_payload, &segment_size);
+}
+
+/* Bigger than the last level cache, so that walking it makes the input cold */
+#define PIPELINE_EVICT_SIZE (64 * 1024 * 1024)
+#define PIPELINE_ROUNDS 3
+
+/* The arguments of pipeline_payload() */
+typedef struct pipeline_args
+{
+	int distance;
+	char *evict;	/* PIPELINE_EVICT_SIZE bytes to walk */
+} pipeline_args;
+
+/*
+ * Decompresses all slices of the payload from cold memory in order, plainly
+ * and with pglz_decompress_pipelined() in both its modes. The times are ns
+ * per byte decompressed, the mean of PIPELINE_ROUNDS rounds.
+ */
+static void pipeline_payload(Tuplestorestate *tupstore, TupleDesc tupdesc, int payload, int slice_size,
+							 void *arg)
+{
+	int distance = ((pipeline_args *) arg)->distance;
+	char *evict = ((pipeline_args *) arg)->evict;
+	char *data = payloads[payload];
+	long size = payload_sizes[payload];
+	int slice_count;
+	PGLZ_Slice *slices;
+	char *compressed;
+	char *extracted_data;
+	int compressed_count = 0;
+	double times[3] = {0, 0, 0};
+	long fetched_ahead = 0;
+	bool measured = true;
+	Datum values[7];
+	bool nulls[7] = {false};
+	int round, mode, i;
+
+	/* a single slice has nothing to overlap with */
+	if (slice_size == 0)
+		return;
+	slice_count = size / slice_size;
+	slices = palloc(slice_count * sizeof(PGLZ_Slice));
+	compressed = palloc((Size) slice_count * PGLZ_MAX_OUTPUT(slice_size));
+	extracted_data = palloc((Size) slice_count * slice_size);
+
+	/* Incompressible slices would be stored raw, so they are not decompressed */
+	for (i = 0; i < slice_count; i++)
+	{
+		char *dest = compressed + (Size) PGLZ_MAX_OUTPUT(slice_size) * i;
+		int32 comp_size = pglz_compress_hacked(data + (Size) slice_size * i, slice_size, dest,
+											   PGLZ_strategy_default);
+
+		if (comp_size == -1)
+			continue;
+		slices[compressed_count].source = dest;
+		slices[compressed_count].slen = comp_size;
+		slices[compressed_count].dest = extracted_data + (Size) slice_size * i;
+		slices[compressed_count].rawsize = slice_size;
+		compressed_count++;
+	}
+
+	for (round = 0; round < PIPELINE_ROUNDS; round++)
+	{
+		for (mode = 0; mode < 3; mode++)
+		{
+			instr_time begin;
+			instr_time end;
+			int ahead;
+
+			for (i = 0; i < PIPELINE_EVICT_SIZE; i += 64)
+				evict[i]++;
+
+			INSTR_TIME_SET_CURRENT(begin);
+			ahead = pglz_decompress_pipelined(slices, compressed_count, pglz_decompress_hacked, true,
+											  mode == 0 ? 0 : distance, mode == 2);
+			INSTR_TIME_SET_CURRENT(end);
+			INSTR_TIME_SUBTRACT(end, begin);
+			times[mode] += INSTR_TIME_GET_DOUBLE(end);
+			/* -1 if no helper thread could be had */
+			if (mode == 2)
+			{
+				if (ahead < 0)
+					measured = false;
+				else
+					fetched_ahead += ahead;
+			}
+
+			for (i = 0; i < compressed_count; i++)
+				if (slices[i].result != slice_size ||
+					memcmp(slices[i].dest, data + (slices[i].dest - extracted_data), slice_size) != 0)
+					elog(ERROR, "pipelined decompression of payload %s is wrong", payload_names[payload]);
+		}
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	values[0] = CStringGetTextDatum(payload_names[payload]);
+	values[1] = Int32GetDatum(slice_size);
+	values[2] = Int32GetDatum(distance);
+	for (mode = 0; mode < 3; mode++)
+	{
+		values[3 + mode] = Float8GetDatum(times[mode] * 1000000000.0 /
+										  ((double) compressed_count * slice_size * PIPELINE_ROUNDS));
+		nulls[3 + mode] = compressed_count == 0;
+	}
+	values[6] = Float8GetDatum((double) fetched_ahead / ((double) compressed_count * PIPELINE_ROUNDS));
+	nulls[6] = compressed_count == 0 || !measured;
+	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+
+	pfree(slices);
+	pfree(compressed);
+	pfree(extracted_data);
+}
+
+/*
+ * SQL-callable entry point to see what fetching the input of the next slices
+ * while decoding the current one saves for sequential scans from cold memory.
+ * overlap is the share of slices whose input the helper thread had read
+ * before their decoding started, measured in background mode only; it is
+ * NULL if no helper thread could be started.
+ */
+Datum
+test_pglz_pipeline(PG_FUNCTION_ARGS)
+{
+	pipeline_args args;
+	Datum result;
+
+	args.distance = PG_GETARG_INT32(2);
+	if (args.distance < 1)
+		elog(ERROR, "prefetch distance must be positive");
+	args.evict = palloc0(PIPELINE_EVICT_SIZE);
+
+	result = materialize_slices(fcinfo, pipeline_payload, &args);
+	pfree(args.evict);
+
+	return result;
+}
+
+#ifdef PGLZ_STATS
+/* A histogram of PGLZ_Stats as an int8[] */
+static Datum stats_histogram(const int64 *hist)
+{
+	Datum elems[PGLZ_STATS_CLASSES];
+	int i;
+
+	for (i = 0; i < PGLZ_STATS_CLASSES; i++)
+		elems[i] = Int64GetDatum(hist[i]);
+	return PointerGetDatum(construct_array(elems, PGLZ_STATS_CLASSES, INT8OID, sizeof(int64), FLOAT8PASSBYVAL, 'd'));
+}
+
+/* Round trips of every slice with the counters reset before */
+static void stats_payload(Tuplestorestate *tupstore, TupleDesc tupdesc, int payload, int slice_size, void *arg)
+{
+	char *data = payloads[payload];
+	long size = payload_sizes[payload];
+	int slice_count;
+	char *compressed;
+	char *extracted;
+	PGLZ_Stats stats;
+	Datum values[15];
+	bool nulls[15] = {false};
+	int i;
+
+	if (slice_size == 0)
+		slice_size = size;
+	slice_count = size / slice_size;
+	compressed = palloc(PGLZ_MAX_OUTPUT(slice_size));
+	extracted = palloc(slice_size);
+
+	pglz_stats_reset();
+	for (i = 0; i < slice_count; i++)
+	{
+		const char *slice = data + (Size) slice_size * i;
+		int32 comp_size;
+
+		comp_size = pglz_compress_hacked(slice, slice_size, compressed, PGLZ_strategy_default);
+		if (comp_size == -1)
+			continue;
+		if (pglz_decompress_hacked(compressed, comp_size, extracted, slice_size, true) != slice_size ||
+			memcmp(extracted, slice, slice_size) != 0)
+			elog(ERROR, "decompression of payload %s is wrong", payload_names[payload]);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+	pglz_stats_collect(&stats);
+
+	values[0] = CStringGetTextDatum(payload_names[payload]);
+	values[1] = Int32GetDatum(slice_size);
+	values[2] = Float8GetDatum(stats.literals /
+							   (double) Max(stats.literals + stats.match_bytes, 1));
+	values[3] = Int64GetDatum(stats.matches);
+	values[4] = Float8GetDatum(stats.match_bytes / (double) Max(stats.matches, 1));
+	values[5] = Int64GetDatum(stats.lookups);
+	values[6] = Float8GetDatum(stats.chain_steps / (double) Max(stats.lookups, 1));
+	values[7] = Int64GetDatum(stats.good_match_stops);
+	values[8] = Int64GetDatum(stats.good_match_decay_stops);
+	values[9] = stats_histogram(stats.chain_length);
+	values[10] = stats_histogram(stats.match_length);
+	values[11] = stats_histogram(stats.match_offset);
+	values[12] = Int64GetDatum(stats.copies);
+	values[13] = Int64GetDatum(stats.overlapping_copies);
+	values[14] = stats_histogram(stats.copy_offset);
+	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+
+	pfree(compressed);
+	pfree(extracted);
+}
+#endif
+
+/*
+ * SQL-callable entry point to report the internal counters of the hacked
+ * compressor and decompressor, one row per payload and slice size. Only
+ * available if the module is built with -DPGLZ_STATS.
+ */
+Datum
+test_pglz_stats(PG_FUNCTION_ARGS)
+{
+#ifdef PGLZ_STATS
+	return materialize_slices(fcinfo, stats_payload, NULL);
+#else
+	elog(ERROR, "test_pglz was built without PGLZ_STATS");
+	PG_RETURN_VOID();
+#endif
+}
+
+/*
+ * SQL-callable entry point to see how batch compression and decompression
+ * scale with the number of threads.
+ */
+Datum
+test_pglz_parallel(PG_FUNCTION_ARGS)
+{
+	int max_threads = PG_GETARG_INT32(0);
+	int slice_size = PG_GETARG_INT32(1);
+	int iterations = 5;
+	int iteration;
+	int p, t;
+	int old_verbosity = Log_error_verbosity;
+
+	if (max_threads < 1 || max_threads > PGLZ_BATCH_MAX_THREADS)
+		elog(ERROR, "number of threads must be between 1 and %d", PGLZ_BATCH_MAX_THREADS);
+	if (slice_size < 1)
+		elog(ERROR, "slice size must be positive");
+
+	prepare_payloads();
+
+	Log_error_verbosity = PGERROR_TERSE;
+	ereport(NOTICE, (errmsg("Time to process one byte in ns, sliced by %d bytes:", slice_size), errhidestmt(true)));
+	for (p = 0; p < payload_count; p++)
+	{
+		double compression_base = 0;
+		double decompression_base = 0;
+
+		if (payload_sizes[p] < slice_size)
+			continue;
+
+		ereport(NOTICE, (errmsg("Payload %s", payload_names[p]), errhidestmt(true)));
+		for (t = 1; t <= max_threads; t++)
+		{
+			double compression_result = 0;
+			double decompression_result = 0;
+
+			for (iteration = 0; iteration < iterations; iteration++)
+			{
+				double compression_time;
+				double decompression_time;
+
+				do_parallel_test(p, slice_size, t, &compression_time, &decompression_time);
+				compression_result += compression_time;
+				decompression_result += decompression_time;
+			}
+			compression_result /= iterations;
+			decompression_result /= iterations;
+
+			if (t == 1)
+			{
+				compression_base = compression_result;
+				decompression_base = decompression_result;
+			}
+
+			ereport(NOTICE, (errmsg("Threads %d compression %f (x%.2f) decompression %f (x%.2f)",
+									t, compression_result, compression_base / compression_result,
+									decompression_result, decompression_base / decompression_result),
+							 errhidestmt(true)));
+		}
+	}
+
+	Log_error_verbosity = old_verbosity;
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * SQL-callable entry point to sweep strategies and compression levels over
+ * all payloads. Configurations that no other configuration beats in both
+ * compression time and ratio are marked as the Pareto front.
+ */
+Datum
+test_pglz_levels(PG_FUNCTION_ARGS)
+{
+	int slice_size = PG_GETARG_INT32(0);
+	const PGLZ_Strategy *strategies[] = {PGLZ_strategy_default, PGLZ_strategy_always};
+	char *strategy_names[] = {"default", "always"};
+	int strategies_count = 2;
+	char *level_names[] = {"fast", "default", "high"};
+	int config_count = strategies_count * PGLZ_LEVEL_COUNT;
+	PGLZ_StrategyExt configs[2 * PGLZ_LEVEL_COUNT];
+	double compression_results[2 * PGLZ_LEVEL_COUNT];
+	double decompression_results[2 * PGLZ_LEVEL_COUNT];
+	double ratios[2 * PGLZ_LEVEL_COUNT];
+	int iterations = 5;
+	int iteration;
+	int p, c, o;
+	int old_verbosity = Log_error_verbosity;
+
+	if (slice_size < 0)
+		elog(ERROR, "slice size must not be negative");
+
+	for (c = 0; c < config_count; c++)
+	{
+		configs[c].strategy = *strategies[c / PGLZ_LEVEL_COUNT];
+		configs[c].level = c % PGLZ_LEVEL_COUNT;
+	}
+
+	prepare_payloads();
+
+	Log_error_verbosity = PGERROR_TERSE;
+	if (slice_size == 0)
+		ereport(NOTICE, (errmsg("Time to process one byte in ns, whole payloads:"), errhidestmt(true)));
+	else
+		ereport(NOTICE, (errmsg("Time to process one byte in ns, sliced by %d bytes:", slice_size), errhidestmt(true)));
+	for (p = 0; p < payload_count; p++)
+	{
+		if (payload_sizes[p] < slice_size)
+			continue;
+
+		for (c = 0; c < config_count; c++)
+		{
+			compression_results[c] = 0;
+			decompression_results[c] = 0;
+			for (iteration = 0; iteration < iterations; iteration++)
+			{
+				double compression_time;
+				double decompression_time;
+
+				do_level_test(&configs[c], p, slice_size, &compression_time, &decompression_time, &ratios[c]);
+				compression_results[c] += compression_time;
+				decompression_results[c] += decompression_time;
+			}
+			compression_results[c] /= iterations;
+			decompression_results[c] /= iterations;
+		}
+
+		ereport(NOTICE, (errmsg("Payload %s", payload_names[p]), errhidestmt(true)));
+		for (c = 0; c < config_count; c++)
+		{
+			bool dominated = false;
+
+			for (o = 0; o < config_count; o++)
+				if (compression_results[o] <= compression_results[c] && ratios[o] <= ratios[c] &&
+					(compression_results[o] < compression_results[c] || ratios[o] < ratios[c]))
+					dominated = true;
+
+			ereport(NOTICE, (errmsg("Strategy %s level %s compression %f decompression %f ratio %f%s",
+									strategy_names[c / PGLZ_LEVEL_COUNT], level_names[c % PGLZ_LEVEL_COUNT],
+									compression_results[c], decompression_results[c], ratios[c],
+									dominated ? "" : " pareto"),
+							 errhidestmt(true)));
+		}
+	}
+
+	Log_error_verbosity = old_verbosity;
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * SQL-callable entry point to stream every payload file through the
+ * streaming compressor and decompressor in chunks of chunk_size bytes.
+ */
+Datum
+test_pglz_stream(PG_FUNCTION_ARGS)
+{
+	int chunk_size = PG_GETARG_INT32(0);
+	int p;
+	int old_verbosity = Log_error_verbosity;
+
+	if (chunk_size < 1)
+		elog(ERROR, "chunk size must be positive");
+
+	Log_error_verbosity = PGERROR_TERSE;
+	ereport(NOTICE, (errmsg("Time to process one byte in ns, streamed by %d bytes:", chunk_size), errhidestmt(true)));
+	for (p = 0; p < payload_file_count; p++)
+	{
+		double compression_result;
+		double decompression_result;
+		double ratio;
+
+		do_stream_test(p, chunk_size, &compression_result, &decompression_result, &ratio);
+		ereport(NOTICE, (errmsg("Payload %s compression %f decompression %f ratio %f",
+								payload_names[p], compression_result, decompression_result, ratio),
+						 errhidestmt(true)));
 	}
 
 	Log_error_verbosity = old_verbosity;